@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "linalg.h"
+
+/*
+ * Contended scatter-add benchmark. Every pair (i, j) adds f to node i and
+ * -f to node j, as a pair force kernel does. The pairs are split between
+ * nthread threads and added to a shared array with each strategy: atomic
+ * adds, striped locks, per-thread scat3 buffers flushed atomically, full
+ * per-thread copies merged at the end, and colors of conflict-free pairs
+ * separated by barriers. Fewer nodes mean more contention.
+ *
+ * Usage: bench [nthread [npair]]
+ */
+
+#define NLOCK 256
+#define SCATCAP 1024
+#define NREP 3
+
+enum { ATOMIC, LOCK, SCAT, COPY, COLOR, NSTRAT };
+
+static const char *stratname[NSTRAT] = {
+	"atomic", "lock", "scat3", "copy", "color"
+};
+
+typedef struct {
+	size_t *conn, *order, *start, npair, nnode, ncolor, nthread;
+	v3 *out, *copy, f;
+	pthread_mutex_t lock[NLOCK];
+	pthread_barrier_t bar;
+	int strat;
+} bench;
+
+typedef struct {
+	bench *b;
+	size_t id;
+} worker;
+
+static void
+pairadd(bench *b, v3 *out, size_t p)
+{
+	out[b->conn[2 * p]] = v3add(out[b->conn[2 * p]], b->f);
+	out[b->conn[2 * p + 1]] = v3sub(out[b->conn[2 * p + 1]], b->f);
+}
+
+static void
+lockadd(bench *b, size_t i, v3 v)
+{
+	pthread_mutex_t *m = &b->lock[i % NLOCK];
+
+	pthread_mutex_lock(m);
+	b->out[i] = v3add(b->out[i], v);
+	pthread_mutex_unlock(m);
+}
+
+static void *
+run(void *arg)
+{
+	worker *w = (worker *)arg;
+	bench *b = w->b;
+	size_t t = w->id, nt = b->nthread, p, p0, p1, c, i, k, *idx;
+	v3 *val, *mine, s;
+	scat3 sc;
+
+	p0 = b->npair * t / nt;
+	p1 = b->npair * (t + 1) / nt;
+	switch (b->strat) {
+	case ATOMIC:
+		for (p = p0; p < p1; p++) {
+			v3atomicadd(&b->out[b->conn[2 * p]], b->f);
+			v3atomicadd(&b->out[b->conn[2 * p + 1]], v3neg(b->f));
+		}
+		break;
+	case LOCK:
+		for (p = p0; p < p1; p++) {
+			lockadd(b, b->conn[2 * p], b->f);
+			lockadd(b, b->conn[2 * p + 1], v3neg(b->f));
+		}
+		break;
+	case SCAT:
+		idx = (size_t *)malloc(SCATCAP * sizeof(*idx));
+		val = (v3 *)malloc(SCATCAP * sizeof(*val));
+		scat3init(&sc, idx, val, SCATCAP);
+		for (p = p0; p < p1; p++) {
+			if (sc.n + 2 > sc.cap)
+				scat3flushatomic(&sc, b->out);
+			scat3add(&sc, b->conn[2 * p], b->f);
+			scat3add(&sc, b->conn[2 * p + 1], v3neg(b->f));
+		}
+		scat3flushatomic(&sc, b->out);
+		free(idx);
+		free(val);
+		break;
+	case COPY:
+		mine = b->copy + t * b->nnode;
+		for (i = 0; i < b->nnode; i++)
+			mine[i] = v3zero();
+		for (p = p0; p < p1; p++)
+			pairadd(b, mine, p);
+		pthread_barrier_wait(&b->bar);
+		for (i = b->nnode * t / nt; i < b->nnode * (t + 1) / nt; i++) {
+			s = b->out[i];
+			for (k = 0; k < nt; k++)
+				s = v3add(s, b->copy[k * b->nnode + i]);
+			b->out[i] = s;
+		}
+		break;
+	case COLOR:
+		for (c = 0; c < b->ncolor; c++) {
+			p0 = b->start[c] + (b->start[c + 1] - b->start[c]) * t / nt;
+			p1 = b->start[c] +
+			    (b->start[c + 1] - b->start[c]) * (t + 1) / nt;
+			for (p = p0; p < p1; p++)
+				pairadd(b, b->out, b->order[p]);
+			pthread_barrier_wait(&b->bar);
+		}
+		break;
+	}
+	return (NULL);
+}
+
+static double
+measure(bench *b, int strat)
+{
+	pthread_t th[64];
+	worker w[64];
+	double best = 0, t;
+	size_t i;
+	int r;
+
+	b->strat = strat;
+	for (r = 0; r < NREP; r++) {
+		for (i = 0; i < b->nnode; i++)
+			b->out[i] = v3zero();
+		t = streamclock();
+		for (i = 0; i < b->nthread; i++) {
+			w[i].b = b;
+			w[i].id = i;
+			pthread_create(&th[i], NULL, run, &w[i]);
+		}
+		for (i = 0; i < b->nthread; i++)
+			pthread_join(th[i], NULL);
+		t = streamclock() - t;
+		if (r == 0 || t < best)
+			best = t;
+	}
+	return (best);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const size_t nodes[] = { 64, 4096, 262144 };
+	size_t nthread = argc > 1 ? (size_t)atol(argv[1]) : 4;
+	size_t npair = argc > 2 ? (size_t)atol(argv[2]) : 1 << 20;
+	size_t i, k, *color;
+	uint64_t *mask;
+	v3 *ref;
+	double t, err;
+	bench b;
+	int s;
+
+	if (nthread < 1 || nthread > 64 || npair < 1) {
+		fprintf(stderr, "usage: bench [nthread [npair]]\n");
+		return (1);
+	}
+	b.nthread = nthread;
+	b.npair = npair;
+	b.f = v3new(1, -2, (real)0.5);
+	b.conn = (size_t *)malloc(2 * npair * sizeof(size_t));
+	b.order = (size_t *)malloc(npair * sizeof(size_t));
+	color = (size_t *)malloc(npair * sizeof(size_t));
+	for (i = 0; i < NLOCK; i++)
+		pthread_mutex_init(&b.lock[i], NULL);
+	pthread_barrier_init(&b.bar, NULL, (unsigned)nthread);
+	printf("%lu threads, %lu pairs\n", (unsigned long)nthread,
+	    (unsigned long)npair);
+	for (k = 0; k < sizeof(nodes) / sizeof(nodes[0]); k++) {
+		b.nnode = nodes[k];
+		b.out = (v3 *)malloc(b.nnode * sizeof(v3));
+		b.copy = (v3 *)malloc(nthread * b.nnode * sizeof(v3));
+		b.start = (size_t *)malloc((npair + 1) * sizeof(size_t));
+		ref = (v3 *)malloc(b.nnode * sizeof(v3));
+		mask = (uint64_t *)malloc(b.nnode * sizeof(uint64_t));
+		srand(1);
+		for (i = 0; i < npair; i++) {
+			b.conn[2 * i] = (size_t)rand() % b.nnode;
+			do {
+				b.conn[2 * i + 1] = (size_t)rand() % b.nnode;
+			} while (b.conn[2 * i + 1] == b.conn[2 * i]);
+		}
+		for (i = 0; i < b.nnode; i++)
+			ref[i] = v3zero();
+		for (i = 0; i < npair; i++)
+			pairadd(&b, ref, i);
+		t = streamclock();
+		b.ncolor = colorgreedy(b.conn, 2, npair, b.nnode, mask, color);
+		colorgroup(color, npair, b.ncolor, b.start, b.order);
+		t = streamclock() - t;
+		printf("%lu nodes, %lu colors in %.3f s\n",
+		    (unsigned long)b.nnode, (unsigned long)b.ncolor, t);
+		for (s = 0; s < NSTRAT; s++) {
+			t = measure(&b, s);
+			for (i = 0, err = 0; i < b.nnode; i++)
+				err += (double)v3dist(b.out[i], ref[i]);
+			printf("  %-8s %8.2f Mpairs/s  error %g\n", stratname[s],
+			    (double)npair / t * 1e-6, err);
+		}
+		free(b.out);
+		free(b.copy);
+		free(b.start);
+		free(ref);
+		free(mask);
+	}
+	pthread_barrier_destroy(&b.bar);
+	for (i = 0; i < NLOCK; i++)
+		pthread_mutex_destroy(&b.lock[i]);
+	free(b.conn);
+	free(b.order);
+	free(color);
+	return (0);
+}
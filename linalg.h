@@ -20,6 +20,23 @@
 #define LINALG_H_INCLUDED
 
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#ifdef LINALG_PROFILE
+#include <stdio.h>
+#if defined(LINALG_PROFILE_PERF) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if !defined(__cplusplus) && !defined(_DEFAULT_SOURCE) && \
+    !defined(_GNU_SOURCE)
+/* Strict ISO modes such as -std=c99 hide the declaration. */
+long syscall(long, ...);
+#endif
+#endif
+#endif
 
 #ifdef __cplusplus
 namespace linalg {
@@ -27,8 +44,10 @@ namespace linalg {
 
 #ifdef LINALG_SINGLE_PRECISION
 typedef float real;
+#define LINALG_EPSILON 1.19209290e-7
 #else /* LINALG_SINGLE_PRECISION */
 typedef double real;
+#define LINALG_EPSILON 2.2204460492503131e-16
 #endif /* LINALG_SINGLE_PRECISION */
 
 typedef struct {
@@ -54,12 +73,436 @@ typedef struct {
 	real w, x, y, z;
 } q4;
 
+typedef struct {
+	real xx, yy, zz, xy, xz, yz;
+} s33;
+
+typedef struct {
+	v3 lo, hi;
+} box3;
+
+typedef struct {
+	v3 o, d;
+} ray3;
+
+typedef struct {
+	real t, u, v;
+	size_t id;
+} hit3;
+
+typedef struct {
+	real *ax, *ay, *az;
+	real *e1x, *e1y, *e1z;
+	real *e2x, *e2y, *e2z;
+} tri3soa;
+
+typedef struct {
+	m33 h, hinv;
+	int ortho;
+} pbc3;
+
+typedef struct {
+	uint64_t seed, stream;
+} rng;
+
+#ifndef LINALG_DUALN
+#define LINALG_DUALN 3
+#endif
+
+typedef struct {
+	real v;
+	real d[LINALG_DUALN];
+} dual;
+
+typedef struct {
+	dual x, y, z;
+} v3d;
+
+typedef struct {
+	dual xx, xy, xz;
+	dual yx, yy, yz;
+	dual zx, zy, zz;
+} m33d;
+
+typedef struct {
+	dual w, x, y, z;
+} q4d;
+
+#ifndef LINALG_HISTLOOK
+#define LINALG_HISTLOOK 4
+#endif
+
+typedef struct {
+	v3 a, b;
+} seg3;
+
+typedef struct {
+	v3 a, b, c;
+} tri3;
+
+typedef struct {
+	v3 n;
+	real d;
+} plane3;
+
+typedef struct {
+	size_t nbin, nlook;
+	real rmax, rmax2, scale;
+	real *edge2;
+	uint32_t *look;
+} hist3;
+
+typedef struct {
+	real *x, *y;
+} v2soa;
+
+typedef struct {
+	real *x, *y, *z;
+} v3soa;
+
+typedef struct {
+	v3soa a, b;
+} seg3soa;
+
+typedef struct {
+	real *w, *x, *y, *z;
+} q4soa;
+
+typedef struct {
+	real *xx, *xy, *yx, *yy;
+} m22soa;
+
+typedef struct {
+	real *xx, *xy, *xz, *yx, *yy, *yz, *zx, *zy, *zz;
+} m33soa;
+
+typedef struct {
+	size_t row, col;
+	m33 m;
+} blk33;
+
+typedef struct {
+	size_t nrow, nnz;
+	size_t *row, *col;
+	m33 *val;
+	int sym;
+} bsr33;
+
+typedef int (*bsr33cgfn)(size_t iter, real res, void *arg);
+
+#ifndef LINALG_ALIGN
+#define LINALG_ALIGN 64
+#endif
+
+#ifndef LINALG_POOLCLASSES
+#define LINALG_POOLCLASSES 16
+#endif
+
+typedef struct {
+	unsigned char *base;
+	size_t size, used;
+} arena;
+
+typedef struct {
+	arena *a;
+	void *free[LINALG_POOLCLASSES];
+} pool;
+
+#define LINALG_TRJMAGIC 0x4a52544cU
+#define LINALG_TRJVERSION 1U
+#define LINALG_TRJAOS 0U
+#define LINALG_TRJSOA 1U
+
+typedef struct {
+	uint32_t magic, version, precision, layout;
+	uint64_t count, nframes, stride, q4off;
+	uint64_t compstride, reserved;
+} trjhdr;
+
+#ifndef LINALG_RINGSIZE
+#define LINALG_RINGSIZE 16
+#endif
+
+typedef struct {
+	size_t slot[LINALG_RINGSIZE];
+	size_t head, tail;
+} ring;
+
+typedef struct {
+	unsigned iters;
+	double res;
+	int ok;
+} irinfo;
+
+typedef struct {
+	size_t *idx;
+	v3 *val;
+	size_t n, cap;
+} scat3;
+
+typedef struct {
+	v3 *p;
+	size_t *idx;
+	unsigned char *axis;
+	size_t n;
+} kd3;
+
+#ifndef LINALG_CHAINMAX
+#define LINALG_CHAINMAX 16
+#endif
+
+typedef struct {
+	m33 m;
+	v3 t;
+} af3;
+
+typedef struct {
+	af3 step[LINALG_CHAINMAX];
+	size_t n;
+} chain3;
+
+#define LINALG_ROWMAJOR 0
+#define LINALG_COLMAJOR 1
+
+typedef struct {
+	real *p;
+	size_t n;
+	ptrdiff_t stride, cstride;
+} v3view;
+
+typedef struct {
+	real *p;
+	size_t n;
+	ptrdiff_t stride, rstride, cstride;
+} m33view;
+
+typedef size_t (*streamreadfn)(void *arg, v3 *buf, size_t max);
+typedef void (*streamwritefn)(void *arg, const v3 *buf, size_t n);
+
+typedef struct {
+	v3 *buf[LINALG_RINGSIZE];
+	size_t len[LINALG_RINGSIZE];
+	size_t nbuf, chunk;
+	ring free, full, done;
+	m33 m;
+	v3 t;
+	streamreadfn rd;
+	streamwritefn wr;
+	double (*now)(void);
+	void *arg;
+	int eof, fin;
+	size_t count[3];
+	double secs[3];
+} stream;
+
+/*
+ * Profiling. When LINALG_PROFILE is defined, instrumented functions count
+ * their calls and nominal floating point operations in thread-local
+ * counters. Flops are counted where they are done: m33inv counts the
+ * cofactors and the scaling, its determinant is counted under m33det,
+ * v3len counts only the square root since v3dot counts the rest, and the
+ * batched kernels count the work not already done in m33v3. Every add,
+ * multiply, divide, sign change and square root in the body counts once,
+ * so m33inv charges 27 for the cofactors, 1 for the reciprocal of the
+ * determinant and 9 for the scaling in m33div.
+ * Exactly one translation unit must also define LINALG_PROFILE_DEFINE to
+ * provide the counter storage. With LINALG_PROFILE_PERF on Linux the
+ * batched kernels additionally record CPU cycles from a per-thread
+ * perf_event counter, which a thread releases with profclose. Without
+ * LINALG_PROFILE the instrumentation compiles to nothing.
+ */
+#ifdef LINALG_PROFILE
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define LINALG_TLS thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define LINALG_TLS _Thread_local
+#elif defined(__GNUC__)
+#define LINALG_TLS __thread
+#else
+#define LINALG_TLS
+#endif
+
+enum {
+	LINALG_P_V2UNIT, LINALG_P_V3DOT, LINALG_P_V3CROSS, LINALG_P_V3LEN,
+	LINALG_P_V3UNIT, LINALG_P_M22INV, LINALG_P_M22SOLVE, LINALG_P_M33V3,
+	LINALG_P_M33M33, LINALG_P_M33DET, LINALG_P_M33INV, LINALG_P_M33SOLVE,
+	LINALG_P_Q4Q4, LINALG_P_Q4NORM, LINALG_P_V3XFORM, LINALG_P_BSR33MV,
+	LINALG_P_COUNT
+};
+
+typedef struct {
+	unsigned long long calls[LINALG_P_COUNT];
+	unsigned long long flops[LINALG_P_COUNT];
+	unsigned long long cycles[LINALG_P_COUNT];
+	unsigned long long start[LINALG_P_COUNT];
+} profstat;
+
+extern LINALG_TLS profstat linalg_prof;
+
+#ifdef LINALG_PROFILE_DEFINE
+LINALG_TLS profstat linalg_prof;
+#endif
+
+#if defined(LINALG_PROFILE_PERF) && defined(__linux__)
+extern LINALG_TLS int linalg_perffd;
+
+#ifdef LINALG_PROFILE_DEFINE
+LINALG_TLS int linalg_perffd;
+#endif
+
+/* linalg_perffd is zero before the first use, the descriptor plus one
+ * once opened and negative if no counter is available. */
+static inline unsigned long long
+profcycles(void)
+{
+	struct perf_event_attr pe;
+	unsigned long long c = 0;
+
+	if (linalg_perffd == 0) {
+		memset(&pe, 0, sizeof(pe));
+		pe.type = PERF_TYPE_HARDWARE;
+		pe.size = sizeof(pe);
+		pe.config = PERF_COUNT_HW_CPU_CYCLES;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+		linalg_perffd = (int)syscall(SYS_perf_event_open, &pe, 0, -1,
+		    -1, 0) + 1;
+		if (linalg_perffd == 0)
+			linalg_perffd = -1;
+	}
+	if (linalg_perffd < 0 || read(linalg_perffd - 1, &c, sizeof(c)) !=
+	    (ssize_t)sizeof(c))
+		return (0);
+	return (c);
+}
+
+/* Close the cycle counter of the calling thread, e.g. before it exits.
+ * The next profcycles call opens a new one. */
+static inline void
+profclose(void)
+{
+	if (linalg_perffd > 0)
+		close(linalg_perffd - 1);
+	linalg_perffd = 0;
+}
+#else
+static inline unsigned long long
+profcycles(void)
+{
+	return (0);
+}
+
+static inline void
+profclose(void)
+{
+}
+#endif
+
+static inline const char *
+profname(unsigned id)
+{
+	static const char *names[LINALG_P_COUNT] = {
+		"v2unit", "v3dot", "v3cross", "v3len", "v3unit", "m22inv",
+		"m22solve", "m33v3", "m33m33", "m33det", "m33inv", "m33solve",
+		"q4q4", "q4norm", "v3xform", "bsr33mv"
+	};
+	return (names[id]);
+}
+
+/* Copy the counters of the calling thread. The start field is scratch
+ * space for cycle sampling. */
+static inline void
+profsnap(profstat *s)
+{
+	*s = linalg_prof;
+}
+
+static inline void
+profreset(void)
+{
+	memset(&linalg_prof, 0, sizeof(linalg_prof));
+}
+
+/* Add counters, e.g. to merge snapshots taken on several threads. */
+static inline void
+profadd(profstat *a, const profstat *b)
+{
+	unsigned i;
+
+	for (i = 0; i < LINALG_P_COUNT; i++) {
+		a->calls[i] += b->calls[i];
+		a->flops[i] += b->flops[i];
+		a->cycles[i] += b->cycles[i];
+	}
+}
+
+/* Print functions that were called, as text or as a JSON object. */
+static inline void
+profdump(FILE *f, const profstat *s, int json)
+{
+	unsigned i;
+	int first = 1;
+
+	if (json)
+		fprintf(f, "{");
+	for (i = 0; i < LINALG_P_COUNT; i++) {
+		if (s->calls[i] == 0)
+			continue;
+		if (json)
+			fprintf(f, "%s\"%s\":{\"calls\":%llu,\"flops\":%llu,"
+			    "\"cycles\":%llu}", first ? "" : ",", profname(i),
+			    s->calls[i], s->flops[i], s->cycles[i]);
+		else
+			fprintf(f, "%-10s %14llu calls %16llu flops %16llu "
+			    "cycles\n", profname(i), s->calls[i], s->flops[i],
+			    s->cycles[i]);
+		first = 0;
+	}
+	if (json)
+		fprintf(f, "}\n");
+}
+
+#define LINALG_PROFFLOPS(id, fl) (linalg_prof.flops[id] += (fl))
+#define LINALG_PROF(id, fl) \
+	(linalg_prof.calls[id]++, LINALG_PROFFLOPS(id, fl))
+#define LINALG_PROFBEGIN(id) (linalg_prof.start[id] = profcycles())
+#define LINALG_PROFEND(id, fl) (LINALG_PROF(id, fl), \
+	linalg_prof.cycles[id] += profcycles() - linalg_prof.start[id])
+
+#else /* LINALG_PROFILE */
+
+#define LINALG_PROFFLOPS(id, fl) ((void)0)
+#define LINALG_PROF(id, fl) ((void)0)
+#define LINALG_PROFBEGIN(id) ((void)0)
+#define LINALG_PROFEND(id, fl) ((void)0)
+
+#endif /* LINALG_PROFILE */
+
 static inline int
 realeq(real a, real b, real eps)
 {
 	return (fabs((double)(a - b)) < (double)eps);
 }
 
+static inline real
+realabs(real a)
+{
+	return (a < 0 ? -a : a);
+}
+
+static inline real
+realmax(real a, real b)
+{
+	return (a > b ? a : b);
+}
+
+static inline real
+realclamp(real a, real lo, real hi)
+{
+	return (a < lo ? lo : a > hi ? hi : a);
+}
+
 static inline v2
 v2new(real x, real y)
 {
@@ -130,6 +573,7 @@ v2len(v2 v)
 static inline v2
 v2unit(v2 v)
 {
+	LINALG_PROF(LINALG_P_V2UNIT, 6);
 	return v2div(v, v2len(v));
 }
 
@@ -205,6 +649,7 @@ v3div(v3 v, real s)
 static inline v3
 v3cross(v3 a, v3 b)
 {
+	LINALG_PROF(LINALG_P_V3CROSS, 9);
 	return v3new(a.y * b.z - a.z * b.y,
 		     a.z * b.x - a.x * b.z,
 		     a.x * b.y - a.y * b.x);
@@ -213,6 +658,7 @@ v3cross(v3 a, v3 b)
 static inline real
 v3dot(v3 a, v3 b)
 {
+	LINALG_PROF(LINALG_P_V3DOT, 5);
 	return (a.x * b.x + a.y * b.y + a.z * b.z);
 }
 
@@ -225,12 +671,14 @@ v3lensq(v3 v)
 static inline real
 v3len(v3 v)
 {
+	LINALG_PROF(LINALG_P_V3LEN, 1);
 	return ((real)sqrt((double)v3lensq(v)));
 }
 
 static inline v3
 v3unit(v3 v)
 {
+	LINALG_PROF(LINALG_P_V3UNIT, 3);
 	return v3div(v, v3len(v));
 }
 
@@ -255,6 +703,22 @@ v3eq(v3 a, v3 b, real eps)
 	return (1);
 }
 
+static inline v3
+v3min(v3 a, v3 b)
+{
+	return v3new(a.x < b.x ? a.x : b.x,
+		     a.y < b.y ? a.y : b.y,
+		     a.z < b.z ? a.z : b.z);
+}
+
+static inline v3
+v3max(v3 a, v3 b)
+{
+	return v3new(a.x > b.x ? a.x : b.x,
+		     a.y > b.y ? a.y : b.y,
+		     a.z > b.z ? a.z : b.z);
+}
+
 static inline m22
 m22new(real xx, real xy, real yx, real yy)
 {
@@ -304,12 +768,19 @@ m22ident(void)
 	return m22new(1, 0, 0, 1);
 }
 
+/* Rotation by the angle whose cosine and sine are c and s. */
+static inline m22
+m22rotcs(real c, real s)
+{
+	return m22new(c, -s, s, c);
+}
+
 static inline m22
 m22rot(real angle)
 {
 	real c = (real)cos((double)angle);
 	real s = (real)sin((double)angle);
-	return m22new(c, -s, s, c);
+	return m22rotcs(c, s);
 }
 
 static inline m22
@@ -380,12 +851,14 @@ static inline m22
 m22inv(m22 m)
 {
 	m22 i = m22new(m.yy, -m.xy, -m.yx, m.xx);
+	LINALG_PROF(LINALG_P_M22INV, 10);
 	return m22div(i, m22det(m));
 }
 
 static inline v2
 m22solve(m22 a, v2 b)
 {
+	LINALG_PROF(LINALG_P_M22SOLVE, 14);
 	return v2new((a.xy*b.y - a.yy*b.x) / (a.xy*a.yx - a.xx*a.yy),
 		     (a.yx*b.x - a.xx*b.y) / (a.xy*a.yx - a.xx*a.yy));
 }
@@ -534,14 +1007,24 @@ m33trans(m33 m)
 static inline v3
 m33v3(m33 m, v3 v)
 {
+	LINALG_PROF(LINALG_P_M33V3, 15);
 	return v3new(m.xx * v.x + m.xy * v.y + m.xz * v.z,
 		     m.yx * v.x + m.yy * v.y + m.yz * v.z,
 		     m.zx * v.x + m.zy * v.y + m.zz * v.z);
 }
 
+static inline v3
+m33tv3(m33 m, v3 v)
+{
+	return v3new(m.xx * v.x + m.yx * v.y + m.zx * v.z,
+		     m.xy * v.x + m.yy * v.y + m.zy * v.z,
+		     m.xz * v.x + m.yz * v.y + m.zz * v.z);
+}
+
 static inline m33
 m33m33(m33 a, m33 b)
 {
+	LINALG_PROF(LINALG_P_M33M33, 45);
 	return m33new(a.xx * b.xx + a.xy * b.yx + a.xz * b.zx,
 		      a.xx * b.xy + a.xy * b.yy + a.xz * b.zy,
 		      a.xx * b.xz + a.xy * b.yz + a.xz * b.zz,
@@ -562,6 +1045,7 @@ m33trace(m33 m)
 static inline real
 m33det(m33 m)
 {
+	LINALG_PROF(LINALG_P_M33DET, 17);
 	return (m.xx * m.yy * m.zz + m.xy * m.yz * m.zx +
 		m.yx * m.zy * m.xz - m.xz * m.yy * m.zx -
 		m.xx * m.yz * m.zy - m.xy * m.yx * m.zz);
@@ -579,6 +1063,7 @@ m33inv(m33 m)
 		       m.yx * m.zy - m.yy * m.zx,
 		       m.zx * m.xy - m.zy * m.xx,
 		       m.xx * m.yy - m.xy * m.yx);
+	LINALG_PROF(LINALG_P_M33INV, 37);
 	return m33div(i, m33det(m));
 }
 
@@ -589,6 +1074,7 @@ m33solve(m33 a, v3 b)
 	real dx = m33det(m33new(b.x,a.xy,a.xz,b.y,a.yy,a.yz,b.z,a.zy,a.zz));
 	real dy = m33det(m33new(a.xx,b.x,a.xz,a.yx,b.y,a.yz,a.zx,b.z,a.zz));
 	real dz = m33det(m33new(a.xx,a.xy,b.x,a.yx,a.yy,b.y,a.zx,a.zy,b.z));
+	LINALG_PROF(LINALG_P_M33SOLVE, 3);
 	return v3new(dx/d, dy/d, dz/d);
 }
 
@@ -607,6 +1093,14 @@ m33eq(m33 a, m33 b, real eps)
 	return (1);
 }
 
+static inline m33
+v3outer(v3 a, v3 b)
+{
+	return m33new(a.x * b.x, a.x * b.y, a.x * b.z,
+		      a.y * b.x, a.y * b.y, a.y * b.z,
+		      a.z * b.x, a.z * b.y, a.z * b.z);
+}
+
 static inline q4
 q4new(real w, real x, real y, real z)
 {
@@ -665,6 +1159,7 @@ q4conj(q4 q)
 static inline q4
 q4q4(q4 a, q4 b)
 {
+	LINALG_PROF(LINALG_P_Q4Q4, 28);
 	return q4new(a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z,
 		     a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
 		     a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
@@ -680,9 +1175,29 @@ q4normsq(q4 q)
 static inline real
 q4norm(q4 q)
 {
+	LINALG_PROF(LINALG_P_Q4NORM, 8);
 	return ((real)sqrt((double)q4normsq(q)));
 }
 
+static inline v3
+q4v3(q4 q, v3 v)
+{
+	v3 u = v3new(q.x, q.y, q.z);
+	v3 t = v3mul(v3cross(u, v), 2);
+	return v3add(v3add(v, v3mul(t, q.w)), v3cross(u, t));
+}
+
+static inline m33
+q4m33(q4 q)
+{
+	real xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	real xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	real wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	return m33new(1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy),
+		      2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx),
+		      2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy));
+}
+
 static inline int
 q4eq(q4 a, q4 b, real eps)
 {
@@ -693,6 +1208,4412 @@ q4eq(q4 a, q4 b, real eps)
 	return (1);
 }
 
+/*
+ * Array reductions. Pairwise sums split the input into blocks of
+ * LINALG_BLOCK elements, sum each block in order and combine the block sums
+ * in a fixed binary tree. The result depends only on the input, so it is
+ * bitwise reproducible as long as the compiler is not allowed to reassociate
+ * floating point operations (no -ffast-math). For threaded code, compute
+ * block sums with *sumblk in any order or on any number of threads and
+ * combine them with *sumtree; the result is identical to *sum.
+ */
+
+#ifndef LINALG_BLOCK
+#define LINALG_BLOCK 256
+#endif
+
+static inline size_t
+realnblk(size_t n)
+{
+	return ((n + LINALG_BLOCK - 1) / LINALG_BLOCK);
+}
+
+static inline real
+realsumblk(const real *a, size_t n, size_t k)
+{
+	size_t i, end = (k + 1) * LINALG_BLOCK;
+	real s = 0;
+
+	if (end > n) end = n;
+	for (i = k * LINALG_BLOCK; i < end; i++)
+		s += a[i];
+	return (s);
+}
+
+static inline real
+realsumrange(const real *a, size_t n, size_t k, size_t nblk)
+{
+	size_t h = nblk / 2;
+
+	if (nblk == 0) return (0);
+	if (nblk == 1) return realsumblk(a, n, k);
+	return (realsumrange(a, n, k, h) + realsumrange(a, n, k + h, nblk - h));
+}
+
+static inline real
+realsumtree(const real *p, size_t nblk)
+{
+	size_t h = nblk / 2;
+
+	if (nblk == 0) return (0);
+	if (nblk == 1) return (p[0]);
+	return (realsumtree(p, h) + realsumtree(p + h, nblk - h));
+}
+
+static inline real
+realsum(const real *a, size_t n)
+{
+	return realsumrange(a, n, 0, realnblk(n));
+}
+
+static inline real
+realsumkahan(const real *a, size_t n)
+{
+	real s = 0, c = 0, y, t;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		y = a[i] - c;
+		t = s + y;
+		c = (t - s) - y;
+		s = t;
+	}
+	return (s);
+}
+
+/* Minimum and maximum of an array. Empty input gives HUGE_VAL and -HUGE_VAL
+ * respectively, the identities of min and max. */
+static inline real
+reallower(const real *a, size_t n)
+{
+	real m = (real)HUGE_VAL;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m = a[i] < m ? a[i] : m;
+	return (m);
+}
+
+static inline real
+realupper(const real *a, size_t n)
+{
+	real m = -(real)HUGE_VAL;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m = a[i] > m ? a[i] : m;
+	return (m);
+}
+
+static inline v3
+v3sumblk(const v3 *a, size_t n, size_t k)
+{
+	size_t i, end = (k + 1) * LINALG_BLOCK;
+	v3 s = v3zero();
+
+	if (end > n) end = n;
+	for (i = k * LINALG_BLOCK; i < end; i++)
+		s = v3add(s, a[i]);
+	return (s);
+}
+
+static inline v3
+v3sumrange(const v3 *a, size_t n, size_t k, size_t nblk)
+{
+	size_t h = nblk / 2;
+
+	if (nblk == 0) return v3zero();
+	if (nblk == 1) return v3sumblk(a, n, k);
+	return v3add(v3sumrange(a, n, k, h), v3sumrange(a, n, k + h, nblk - h));
+}
+
+static inline v3
+v3sumtree(const v3 *p, size_t nblk)
+{
+	size_t h = nblk / 2;
+
+	if (nblk == 0) return v3zero();
+	if (nblk == 1) return (p[0]);
+	return v3add(v3sumtree(p, h), v3sumtree(p + h, nblk - h));
+}
+
+static inline v3
+v3sum(const v3 *a, size_t n)
+{
+	return v3sumrange(a, n, 0, realnblk(n));
+}
+
+static inline v3
+v3sumkahan(const v3 *a, size_t n)
+{
+	v3 s = v3zero(), c = v3zero(), y, t;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		y = v3sub(a[i], c);
+		t = v3add(s, y);
+		c = v3sub(v3sub(t, s), y);
+		s = t;
+	}
+	return (s);
+}
+
+static inline v3
+v3wsumrange(const v3 *a, const real *w, size_t n, size_t k, size_t nblk)
+{
+	size_t i, end, h = nblk / 2;
+	v3 s = v3zero();
+
+	if (nblk > 1)
+		return v3add(v3wsumrange(a, w, n, k, h),
+			     v3wsumrange(a, w, n, k + h, nblk - h));
+	end = (k + nblk) * LINALG_BLOCK;
+	if (end > n) end = n;
+	for (i = k * LINALG_BLOCK; i < end; i++)
+		s = v3add(s, v3mul(a[i], w[i]));
+	return (s);
+}
+
+static inline v3
+v3wsum(const v3 *a, const real *w, size_t n)
+{
+	return v3wsumrange(a, w, n, 0, realnblk(n));
+}
+
+/* Centroids and second moments. Empty input, or zero total weight, gives
+ * zero rather than a division by zero. */
+static inline v3
+v3centroid(const v3 *a, size_t n)
+{
+	if (n == 0) return v3zero();
+	return v3div(v3sum(a, n), (real)n);
+}
+
+static inline v3
+v3wcentroid(const v3 *a, const real *w, size_t n)
+{
+	real s = realsum(w, n);
+
+	if (s == 0) return v3zero();
+	return v3div(v3wsum(a, w, n), s);
+}
+
+static inline m33
+v3momentrange(const v3 *a, v3 c, size_t n, size_t k, size_t nblk)
+{
+	size_t i, end, h = nblk / 2;
+	m33 s = m33zero();
+	v3 d;
+
+	if (nblk > 1)
+		return m33add(v3momentrange(a, c, n, k, h),
+			      v3momentrange(a, c, n, k + h, nblk - h));
+	end = (k + nblk) * LINALG_BLOCK;
+	if (end > n) end = n;
+	for (i = k * LINALG_BLOCK; i < end; i++) {
+		d = v3sub(a[i], c);
+		s = m33add(s, v3outer(d, d));
+	}
+	return (s);
+}
+
+static inline m33
+v3moment(const v3 *a, v3 c, size_t n)
+{
+	if (n == 0) return m33zero();
+	return m33div(v3momentrange(a, c, n, 0, realnblk(n)), (real)n);
+}
+
+static inline m33
+v3cov(const v3 *a, size_t n)
+{
+	return v3moment(a, v3centroid(a, n), n);
+}
+
+/* Componentwise minimum and maximum; empty input gives infinities as in
+ * reallower and realupper. */
+static inline v3
+v3lower(const v3 *a, size_t n)
+{
+	real inf = (real)HUGE_VAL;
+	v3 m = v3new(inf, inf, inf);
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m = v3min(m, a[i]);
+	return (m);
+}
+
+static inline v3
+v3upper(const v3 *a, size_t n)
+{
+	real inf = -(real)HUGE_VAL;
+	v3 m = v3new(inf, inf, inf);
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m = v3max(m, a[i]);
+	return (m);
+}
+
+static inline box3
+box3new(v3 lo, v3 hi)
+{
+	box3 b = { lo, hi };
+	return (b);
+}
+
+static inline box3
+box3empty(void)
+{
+	real inf = (real)HUGE_VAL;
+	return box3new(v3new(inf, inf, inf), v3new(-inf, -inf, -inf));
+}
+
+static inline box3
+box3add(box3 b, v3 p)
+{
+	return box3new(v3min(b.lo, p), v3max(b.hi, p));
+}
+
+static inline box3
+box3merge(box3 a, box3 b)
+{
+	return box3new(v3min(a.lo, b.lo), v3max(a.hi, b.hi));
+}
+
+static inline v3
+box3center(box3 b)
+{
+	return v3mul(v3add(b.lo, b.hi), (real)0.5);
+}
+
+static inline v3
+box3extent(box3 b)
+{
+	return v3sub(b.hi, b.lo);
+}
+
+static inline int
+box3overlap(box3 a, box3 b)
+{
+	return ((a.lo.x <= b.hi.x) & (b.lo.x <= a.hi.x) &
+		(a.lo.y <= b.hi.y) & (b.lo.y <= a.hi.y) &
+		(a.lo.z <= b.hi.z) & (b.lo.z <= a.hi.z));
+}
+
+static inline int
+box3inside(box3 b, v3 p)
+{
+	return ((b.lo.x <= p.x) & (p.x <= b.hi.x) &
+		(b.lo.y <= p.y) & (p.y <= b.hi.y) &
+		(b.lo.z <= p.z) & (p.z <= b.hi.z));
+}
+
+static inline int
+box3eq(box3 a, box3 b, real eps)
+{
+	return (v3eq(a.lo, b.lo, eps) && v3eq(a.hi, b.hi, eps));
+}
+
+/* Bounding box of n points. Empty input gives box3empty(). */
+static inline box3
+box3of(const v3 *a, size_t n)
+{
+	return box3new(v3lower(a, n), v3upper(a, n));
+}
+
+static inline box3
+box3ofsoa(const real *x, const real *y, const real *z, size_t n)
+{
+	return box3new(v3new(reallower(x, n), reallower(y, n), reallower(z, n)),
+		       v3new(realupper(x, n), realupper(y, n), realupper(z, n)));
+}
+
+/* Build one box per chunk of points. Returns the number of boxes. A zero
+ * chunk size means a single chunk of all n points. */
+static inline size_t
+box3chunks(const v3 *a, size_t n, size_t chunk, box3 *out)
+{
+	size_t i, k = 0;
+
+	if (chunk == 0) chunk = n;
+	for (i = 0; i < n; i += chunk, k++)
+		out[k] = box3of(a + i, n - i < chunk ? n - i : chunk);
+	return (k);
+}
+
+/* Test a box against n boxes. Returns the number of overlaps. */
+static inline size_t
+box3overlaps(box3 q, const box3 *b, size_t n, int *hit)
+{
+	size_t i, cnt = 0;
+
+	for (i = 0; i < n; i++) {
+		hit[i] = box3overlap(q, b[i]);
+		cnt += (size_t)hit[i];
+	}
+	return (cnt);
+}
+
+/* Test n points against a box. Returns the number of points inside. */
+static inline size_t
+box3insides(box3 q, const v3 *p, size_t n, int *hit)
+{
+	size_t i, cnt = 0;
+
+	for (i = 0; i < n; i++) {
+		hit[i] = box3inside(q, p[i]);
+		cnt += (size_t)hit[i];
+	}
+	return (cnt);
+}
+
+static inline ray3
+ray3new(v3 o, v3 d)
+{
+	ray3 r = { o, d };
+	return (r);
+}
+
+static inline v3
+ray3at(ray3 r, real t)
+{
+	return v3add(r.o, v3mul(r.d, t));
+}
+
+static inline hit3
+hit3none(void)
+{
+	hit3 h = { (real)HUGE_VAL, 0, 0, (size_t)-1 };
+	return (h);
+}
+
+/* Moller-Trumbore test against the triangle a, a + e1, a + e2. Returns the
+ * hit distance and barycentrics, or HUGE_VAL if the ray misses. */
+static inline real
+ray3tri(ray3 r, v3 a, v3 e1, v3 e2, real *u, real *v)
+{
+	v3 p = v3cross(r.d, e2);
+	v3 s = v3sub(r.o, a);
+	v3 q = v3cross(s, e1);
+	real det = v3dot(e1, p);
+	real inv = (real)1.0 / det;
+	real t = v3dot(e2, q) * inv;
+
+	*u = v3dot(s, p) * inv;
+	*v = v3dot(r.d, q) * inv;
+	if ((fabs((double)det) > 0) & (*u >= 0) & (*v >= 0) &
+	    (*u + *v <= 1) & (t > 0))
+		return (t);
+	return ((real)HUGE_VAL);
+}
+
+static inline void
+tri3soaset(tri3soa s, size_t i, v3 a, v3 b, v3 c)
+{
+	v3 e1 = v3sub(b, a), e2 = v3sub(c, a);
+
+	s.ax[i] = a.x; s.ay[i] = a.y; s.az[i] = a.z;
+	s.e1x[i] = e1.x; s.e1y[i] = e1.y; s.e1z[i] = e1.z;
+	s.e2x[i] = e2.x; s.e2y[i] = e2.y; s.e2z[i] = e2.z;
+}
+
+/* Intersect one ray with n triangles, one triangle per lane. Updates h if a
+ * nearer hit is found and returns nonzero in that case. */
+static inline int
+ray3tris(ray3 r, tri3soa s, size_t n, hit3 *h)
+{
+	real t, u, v;
+	size_t i;
+	int found = 0;
+
+	for (i = 0; i < n; i++) {
+		t = ray3tri(r, v3new(s.ax[i], s.ay[i], s.az[i]),
+		    v3new(s.e1x[i], s.e1y[i], s.e1z[i]),
+		    v3new(s.e2x[i], s.e2y[i], s.e2z[i]), &u, &v);
+		if (t < h->t) {
+			h->t = t;
+			h->u = u;
+			h->v = v;
+			h->id = i;
+			found = 1;
+		}
+	}
+	return (found);
+}
+
+/* Intersect a packet of n rays (typically 4, 8 or 16) with one triangle,
+ * one ray per lane. Updates the hits of rays that found a nearer hit and
+ * returns their number. */
+static inline size_t
+ray3packet(const ray3 *r, size_t n, v3 a, v3 b, v3 c, size_t id, hit3 *h)
+{
+	v3 e1 = v3sub(b, a), e2 = v3sub(c, a);
+	real t, u, v;
+	size_t i, cnt = 0;
+
+	for (i = 0; i < n; i++) {
+		t = ray3tri(r[i], a, e1, e2, &u, &v);
+		if (t < h[i].t) {
+			h[i].t = t;
+			h[i].u = u;
+			h[i].v = v;
+			h[i].id = id;
+			cnt++;
+		}
+	}
+	return (cnt);
+}
+
+/* Slab test. inv holds reciprocals of the ray direction. Returns the entry
+ * distance clamped to zero, or HUGE_VAL if the ray misses the box within
+ * [0, tmax]. The box is closed: a ray parallel to a face and starting on
+ * it hits. */
+static inline real
+ray3box(ray3 r, v3 inv, box3 b, real tmax)
+{
+	v3 t0 = v3sub(b.lo, r.o), t1 = v3sub(b.hi, r.o);
+	v3 lo, hi;
+	real tn, tf;
+
+	t0 = v3new(t0.x * inv.x, t0.y * inv.y, t0.z * inv.z);
+	t1 = v3new(t1.x * inv.x, t1.y * inv.y, t1.z * inv.z);
+	/* 0 * inf is NaN for an origin on a slab plane with a zero direction
+	 * component; use the limit from inside the slab instead. */
+	t0 = v3new(t0.x == t0.x ? t0.x : -inv.x, t0.y == t0.y ? t0.y : -inv.y,
+	    t0.z == t0.z ? t0.z : -inv.z);
+	t1 = v3new(t1.x == t1.x ? t1.x : inv.x, t1.y == t1.y ? t1.y : inv.y,
+	    t1.z == t1.z ? t1.z : inv.z);
+	lo = v3min(t0, t1);
+	hi = v3max(t0, t1);
+	tn = lo.x > lo.y ? lo.x : lo.y;
+	tn = tn > lo.z ? tn : lo.z;
+	tn = tn > 0 ? tn : 0;
+	tf = hi.x < hi.y ? hi.x : hi.y;
+	tf = tf < hi.z ? tf : hi.z;
+	tf = tf < tmax ? tf : tmax;
+	return (tn <= tf ? tn : (real)HUGE_VAL);
+}
+
+/* Slab test of one ray against n boxes. Returns the number of boxes hit. */
+static inline size_t
+ray3boxes(ray3 r, const box3 *b, size_t n, real tmax, real *t)
+{
+	v3 inv = v3new((real)1.0 / r.d.x, (real)1.0 / r.d.y,
+	    (real)1.0 / r.d.z);
+	size_t i, cnt = 0;
+
+	for (i = 0; i < n; i++) {
+		t[i] = ray3box(r, inv, b[i], tmax);
+		cnt += (size_t)(t[i] < (real)HUGE_VAL);
+	}
+	return (cnt);
+}
+
+static inline blk33
+blk33new(size_t row, size_t col, m33 m)
+{
+	blk33 b = { row, col, m };
+	return (b);
+}
+
+/*
+ * Assemble a block compressed sparse row matrix with nrow block rows from n
+ * triplets. Duplicate blocks are summed. If sym is nonzero the matrix is
+ * symmetric and only its upper triangle is stored: blocks below the diagonal
+ * are ignored, so the triplets may hold either the full matrix or just its
+ * upper triangle. row must hold nrow + 1 entries, col and val must hold n
+ * entries each.
+ */
+static inline bsr33
+bsr33build(const blk33 *t, size_t n, size_t nrow, int sym,
+    size_t *row, size_t *col, m33 *val)
+{
+	bsr33 a;
+	size_t i, j, k, r, c, p, beg, end;
+	m33 m;
+
+	for (r = 0; r <= nrow; r++)
+		row[r] = 0;
+	for (i = 0; i < n; i++)
+		if (!sym || t[i].row <= t[i].col)
+			row[t[i].row + 1]++;
+	for (r = 0; r < nrow; r++)
+		row[r + 1] += row[r];
+	for (i = 0; i < n; i++) {
+		if (sym && t[i].row > t[i].col)
+			continue;
+		p = row[t[i].row]++;
+		col[p] = t[i].col;
+		val[p] = t[i].m;
+	}
+	for (r = nrow; r > 0; r--)
+		row[r] = row[r - 1];
+	row[0] = 0;
+	for (r = 0, k = 0; r < nrow; r++) {
+		beg = row[r];
+		end = row[r + 1];
+		for (i = beg + 1; i < end; i++) {
+			c = col[i];
+			m = val[i];
+			for (j = i; j > beg && col[j - 1] > c; j--) {
+				col[j] = col[j - 1];
+				val[j] = val[j - 1];
+			}
+			col[j] = c;
+			val[j] = m;
+		}
+		row[r] = k;
+		for (i = beg; i < end; i++) {
+			if (k > row[r] && col[k - 1] == col[i]) {
+				val[k - 1] = m33add(val[k - 1], val[i]);
+			} else {
+				col[k] = col[i];
+				val[k] = val[i];
+				k++;
+			}
+		}
+	}
+	row[nrow] = k;
+	a.nrow = nrow;
+	a.nnz = k;
+	a.row = row;
+	a.col = col;
+	a.val = val;
+	a.sym = sym;
+	return (a);
+}
+
+/* y = A x for block rows [r0, r1) of a general matrix. Row ranges are
+ * independent and can be processed by different threads. */
+static inline void
+bsr33mvrows(const bsr33 *a, const v3 *x, v3 *y, size_t r0, size_t r1)
+{
+	size_t r, p;
+	v3 s;
+
+	for (r = r0; r < r1; r++) {
+		s = v3zero();
+		for (p = a->row[r]; p < a->row[r + 1]; p++)
+			s = v3add(s, m33v3(a->val[p], x[a->col[p]]));
+		y[r] = s;
+	}
+}
+
+/* y = A x. Symmetric matrices scatter the transposed upper triangle, so
+ * they are processed in a single pass over all rows. */
+static inline void
+bsr33mv(const bsr33 *a, const v3 *x, v3 *y)
+{
+	size_t r, p, c;
+	v3 s;
+
+	LINALG_PROFBEGIN(LINALG_P_BSR33MV);
+	if (!a->sym) {
+		bsr33mvrows(a, x, y, 0, a->nrow);
+		LINALG_PROFEND(LINALG_P_BSR33MV, 3 * a->nnz);
+		return;
+	}
+	for (r = 0; r < a->nrow; r++)
+		y[r] = v3zero();
+	for (r = 0; r < a->nrow; r++) {
+		s = y[r];
+		for (p = a->row[r]; p < a->row[r + 1]; p++) {
+			c = a->col[p];
+			s = v3add(s, m33v3(a->val[p], x[c]));
+			if (c != r) {
+				y[c] = v3add(y[c], m33tv3(a->val[p], x[r]));
+				LINALG_PROFFLOPS(LINALG_P_BSR33MV, 18);
+			}
+		}
+		y[r] = s;
+	}
+	LINALG_PROFEND(LINALG_P_BSR33MV, 3 * a->nnz);
+}
+
+static inline real
+v3dotsum(const v3 *a, const v3 *b, size_t n)
+{
+	real s = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		s += v3dot(a[i], b[i]);
+	return (s);
+}
+
+/* Store inverses of the diagonal blocks of a for block-Jacobi
+ * preconditioning. Rows without a diagonal block get the identity. */
+static inline void
+bsr33jacobi(const bsr33 *a, m33 *pre)
+{
+	size_t r, p;
+
+	for (r = 0; r < a->nrow; r++) {
+		pre[r] = m33ident();
+		for (p = a->row[r]; p < a->row[r + 1]; p++)
+			if (a->col[p] == r)
+				pre[r] = m33inv(a->val[p]);
+	}
+}
+
+/*
+ * Preconditioned conjugate gradient for a symmetric positive definite a.
+ * x holds the initial guess on entry and the solution on exit. pre is the
+ * block preconditioner from bsr33jacobi or NULL for none. work must hold
+ * 3 * nrow vectors and is reused across calls, so nothing is allocated.
+ * Iterations stop when the residual norm drops below tol times the norm of
+ * b, after maxit iterations, or when fn returns nonzero. fn may be NULL.
+ * Returns the number of iterations done.
+ */
+static inline size_t
+bsr33cg(const bsr33 *a, const m33 *pre, const v3 *b, v3 *x, v3 *work,
+    size_t maxit, real tol, bsr33cgfn fn, void *arg)
+{
+	size_t i, it, n = a->nrow;
+	v3 *r = work, *p = work + n, *q = work + 2 * n;
+	real bn, rz, rznew, rr, alpha, beta;
+
+	bn = (real)sqrt((double)v3dotsum(b, b, n));
+	bsr33mv(a, x, q);
+	rz = rr = 0;
+	for (i = 0; i < n; i++) {
+		r[i] = v3sub(b[i], q[i]);
+		p[i] = pre ? m33v3(pre[i], r[i]) : r[i];
+		rz += v3dot(r[i], p[i]);
+		rr += v3dot(r[i], r[i]);
+	}
+	for (it = 0; it < maxit; it++) {
+		if (fn && fn(it, (real)sqrt((double)rr), arg))
+			break;
+		if (rr <= tol * tol * bn * bn)
+			break;
+		bsr33mv(a, p, q);
+		alpha = rz / v3dotsum(p, q, n);
+		rznew = rr = 0;
+		for (i = 0; i < n; i++) {
+			x[i] = v3add(x[i], v3mul(p[i], alpha));
+			r[i] = v3sub(r[i], v3mul(q[i], alpha));
+			q[i] = pre ? m33v3(pre[i], r[i]) : r[i];
+			rznew += v3dot(r[i], q[i]);
+			rr += v3dot(r[i], r[i]);
+		}
+		beta = rznew / rz;
+		rz = rznew;
+		for (i = 0; i < n; i++)
+			p[i] = v3add(q[i], v3mul(p[i], beta));
+	}
+	return (it);
+}
+
+/*
+ * Bump allocator over caller-supplied memory. All allocations are aligned
+ * to LINALG_ALIGN bytes. Memory is never returned to the system; use
+ * arenamark and arenareset to release everything allocated after a mark.
+ * For huge-page or NUMA-local backing, pass memory obtained accordingly
+ * (e.g. mmap with MAP_HUGETLB) and touch it with memtouch from the thread
+ * that will use it.
+ */
+static inline arena
+arenanew(void *buf, size_t size)
+{
+	arena a;
+	size_t pad = (LINALG_ALIGN - (size_t)buf % LINALG_ALIGN) % LINALG_ALIGN;
+
+	a.base = (unsigned char *)buf + pad;
+	a.size = size > pad ? size - pad : 0;
+	a.used = 0;
+	return (a);
+}
+
+static inline size_t
+alignsize(size_t size)
+{
+	return ((size + LINALG_ALIGN - 1) / LINALG_ALIGN * LINALG_ALIGN);
+}
+
+static inline void *
+arenaalloc(arena *a, size_t size)
+{
+	void *p;
+
+	size = alignsize(size);
+	if (size == 0 || size > a->size - a->used)
+		return (NULL);
+	p = a->base + a->used;
+	a->used += size;
+	return (p);
+}
+
+static inline size_t
+arenamark(const arena *a)
+{
+	return (a->used);
+}
+
+static inline void
+arenareset(arena *a, size_t mark)
+{
+	a->used = mark;
+}
+
+static inline real *
+arenareal(arena *a, size_t n)
+{
+	return ((real *)arenaalloc(a, n * sizeof(real)));
+}
+
+static inline v3 *
+arenav3(arena *a, size_t n)
+{
+	return ((v3 *)arenaalloc(a, n * sizeof(v3)));
+}
+
+static inline m33 *
+arenam33(arena *a, size_t n)
+{
+	return ((m33 *)arenaalloc(a, n * sizeof(m33)));
+}
+
+static inline q4 *
+arenaq4(arena *a, size_t n)
+{
+	return ((q4 *)arenaalloc(a, n * sizeof(q4)));
+}
+
+/* Write zeros to memory one page at a time so that the pages are placed
+ * on the NUMA node of the calling thread. */
+static inline void
+memtouch(void *p, size_t size, size_t page)
+{
+	volatile unsigned char *c = (volatile unsigned char *)p;
+	size_t i;
+
+	for (i = 0; i < size; i += page)
+		c[i] = 0;
+}
+
+/*
+ * Size-class pool on top of an arena. Class k holds blocks of
+ * LINALG_ALIGN << k bytes. Freed blocks are kept on per-class free lists
+ * and reused by later allocations of the same class.
+ */
+static inline pool
+poolnew(arena *a)
+{
+	pool p;
+	size_t k;
+
+	p.a = a;
+	for (k = 0; k < LINALG_POOLCLASSES; k++)
+		p.free[k] = NULL;
+	return (p);
+}
+
+static inline size_t
+poolclass(size_t size)
+{
+	size_t k = 0;
+
+	while (k < LINALG_POOLCLASSES && ((size_t)LINALG_ALIGN << k) < size)
+		k++;
+	return (k);
+}
+
+static inline void *
+poolalloc(pool *p, size_t size)
+{
+	size_t k = poolclass(size);
+	void *b;
+
+	if (k == LINALG_POOLCLASSES)
+		return (NULL);
+	if ((b = p->free[k]) != NULL) {
+		p->free[k] = *(void **)b;
+		return (b);
+	}
+	return arenaalloc(p->a, (size_t)LINALG_ALIGN << k);
+}
+
+static inline void
+poolfree(pool *p, void *b, size_t size)
+{
+	size_t k = poolclass(size);
+
+	if (b == NULL || k == LINALG_POOLCLASSES)
+		return;
+	*(void **)b = p->free[k];
+	p->free[k] = b;
+}
+
+/*
+ * Binary trajectory container. The file starts with a trjhdr followed by
+ * nframes frames of stride bytes each. A frame holds count positions and,
+ * if q4off is nonzero, count orientations at q4off bytes into the frame.
+ * In the AoS layout positions are a v3 array and orientations a q4 array.
+ * In the SoA layout every component is a separate real array starting at a
+ * multiple of compstride: x, y, z, then w, x, y, z of the orientations.
+ * Frames and arrays are LINALG_ALIGN-aligned, so a file mapped with mmap
+ * can be used in place. Data is stored in native byte order and precision.
+ */
+static inline size_t
+trjinit(void *base, size_t count, size_t nframes, uint32_t layout, int q4s)
+{
+	trjhdr *h = (trjhdr *)base;
+	size_t cs = alignsize(count * sizeof(real));
+
+	h->magic = LINALG_TRJMAGIC;
+	h->version = LINALG_TRJVERSION;
+	h->precision = (uint32_t)sizeof(real);
+	h->layout = layout;
+	h->count = count;
+	h->nframes = nframes;
+	h->compstride = layout == LINALG_TRJSOA ? cs : 0;
+	if (layout == LINALG_TRJSOA)
+		h->q4off = 3 * cs;
+	else
+		h->q4off = alignsize(count * sizeof(v3));
+	if (layout == LINALG_TRJSOA)
+		h->stride = q4s ? 7 * cs : 3 * cs;
+	else if (q4s)
+		h->stride = h->q4off + alignsize(count * sizeof(q4));
+	else
+		h->stride = h->q4off;
+	if (!q4s)
+		h->q4off = 0;
+	h->reserved = 0;
+	return (alignsize(sizeof(trjhdr)) + nframes * (size_t)h->stride);
+}
+
+/* Validate a mapped container of size bytes. Returns its header or NULL
+ * if the data is not a container of this precision or the header describes
+ * frames or arrays that are misaligned, overlap or do not fit in size
+ * bytes. Every view returned for a valid header lies inside the mapping. */
+static inline const trjhdr *
+trjopen(const void *base, size_t size)
+{
+	const trjhdr *h = (const trjhdr *)base;
+	uint64_t avail, stride, q4off, cs, ncomp;
+
+	if (size < alignsize(sizeof(trjhdr))) return (NULL);
+	if (h->magic != LINALG_TRJMAGIC) return (NULL);
+	if (h->version != LINALG_TRJVERSION) return (NULL);
+	if (h->precision != sizeof(real)) return (NULL);
+	if (h->layout != LINALG_TRJAOS && h->layout != LINALG_TRJSOA)
+		return (NULL);
+	avail = size - alignsize(sizeof(trjhdr));
+	stride = h->stride;
+	q4off = h->q4off;
+	cs = h->compstride;
+	if ((stride | q4off | cs) % LINALG_ALIGN) return (NULL);
+	if (h->nframes > 0 && stride > avail) return (NULL);
+	if (stride != 0 && h->nframes > avail / stride) return (NULL);
+	if (h->layout == LINALG_TRJAOS) {
+		if (cs != 0) return (NULL);
+		if (h->count > stride / sizeof(v3)) return (NULL);
+		if (q4off == 0) return (h);
+		if (q4off < h->count * sizeof(v3) || q4off > stride)
+			return (NULL);
+		if (h->count > (stride - q4off) / sizeof(q4)) return (NULL);
+		return (h);
+	}
+	ncomp = q4off == 0 ? 3 : 7;
+	if (cs > stride / ncomp) return (NULL);
+	if (h->count > cs / sizeof(real)) return (NULL);
+	if (q4off != 0 && q4off != 3 * cs) return (NULL);
+	return (h);
+}
+
+static inline const unsigned char *
+trjframe(const void *base, size_t i)
+{
+	const trjhdr *h = (const trjhdr *)base;
+
+	return ((const unsigned char *)base + alignsize(sizeof(trjhdr)) +
+	    i * (size_t)h->stride);
+}
+
+/* Return the positions and orientations of frame i in the AoS layout, or
+ * NULL for an SoA container. */
+static inline const v3 *
+trjv3(const void *base, size_t i)
+{
+	const trjhdr *h = (const trjhdr *)base;
+
+	if (h->layout != LINALG_TRJAOS) return (NULL);
+	return ((const v3 *)trjframe(base, i));
+}
+
+static inline const q4 *
+trjq4(const void *base, size_t i)
+{
+	const trjhdr *h = (const trjhdr *)base;
+
+	if (h->layout != LINALG_TRJAOS || h->q4off == 0) return (NULL);
+	return ((const q4 *)(trjframe(base, i) + (size_t)h->q4off));
+}
+
+/* Return component k of frame i in the SoA layout: 0-2 are the position
+ * x, y, z arrays, 3-6 the orientation w, x, y, z arrays. Returns NULL for
+ * an AoS container or a missing component. */
+static inline const real *
+trjsoa(const void *base, size_t i, unsigned k)
+{
+	const trjhdr *h = (const trjhdr *)base;
+
+	if (h->layout != LINALG_TRJSOA) return (NULL);
+	if (k >= 7 || (k >= 3 && h->q4off == 0)) return (NULL);
+	return ((const real *)(trjframe(base, i) + k * (size_t)h->compstride));
+}
+
+/* Store frame i of a container set up with trjinit. rot may be NULL if the
+ * container has no orientations. */
+static inline void
+trjput(void *base, size_t i, const v3 *pos, const q4 *rot)
+{
+	const trjhdr *h = (const trjhdr *)base;
+	unsigned char *f = (unsigned char *)base + alignsize(sizeof(trjhdr)) +
+	    i * (size_t)h->stride;
+	size_t j, k, n = (size_t)h->count;
+	real *c[7];
+
+	if (h->q4off == 0)
+		rot = NULL;
+	if (h->layout == LINALG_TRJAOS) {
+		for (j = 0; j < n; j++)
+			((v3 *)f)[j] = pos[j];
+		for (j = 0; rot && j < n; j++)
+			((q4 *)(f + (size_t)h->q4off))[j] = rot[j];
+		return;
+	}
+	for (k = 0; k < 7; k++)
+		c[k] = (real *)(f + k * (size_t)h->compstride);
+	for (j = 0; j < n; j++) {
+		c[0][j] = pos[j].x;
+		c[1][j] = pos[j].y;
+		c[2][j] = pos[j].z;
+	}
+	for (j = 0; rot && j < n; j++) {
+		c[3][j] = rot[j].w;
+		c[4][j] = rot[j].x;
+		c[5][j] = rot[j].y;
+		c[6][j] = rot[j].z;
+	}
+}
+
+static inline void
+v3xform(m33 m, v3 t, const v3 *in, v3 *out, size_t n)
+{
+	size_t i;
+
+	LINALG_PROFBEGIN(LINALG_P_V3XFORM);
+	for (i = 0; i < n; i++)
+		out[i] = v3add(m33v3(m, in[i]), t);
+	LINALG_PROFEND(LINALG_P_V3XFORM, 3 * n);
+}
+
+/*
+ * Bounded single-producer single-consumer queue of buffer indices. One
+ * thread may push while another pops without locking. With GCC-compatible
+ * compilers the counters use acquire/release atomics; elsewhere the queue
+ * is only safe to use from a single thread.
+ */
+#if defined(__GNUC__)
+#define LINALG_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LINALG_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define LINALG_LOAD(p) (*(p))
+#define LINALG_STORE(p, v) (*(p) = (v))
+#endif
+
+static inline void
+ringinit(ring *r)
+{
+	r->head = 0;
+	r->tail = 0;
+}
+
+static inline int
+ringpush(ring *r, size_t v)
+{
+	size_t t = r->tail;
+
+	if (t - LINALG_LOAD(&r->head) == LINALG_RINGSIZE)
+		return (0);
+	r->slot[t % LINALG_RINGSIZE] = v;
+	LINALG_STORE(&r->tail, t + 1);
+	return (1);
+}
+
+static inline int
+ringpop(ring *r, size_t *v)
+{
+	size_t h = r->head;
+
+	if (LINALG_LOAD(&r->tail) == h)
+		return (0);
+	*v = r->slot[h % LINALG_RINGSIZE];
+	LINALG_STORE(&r->head, h + 1);
+	return (1);
+}
+
+/*
+ * Streaming pipeline. Chunks of up to chunk points are read into one of
+ * nbuf reusable buffers by rd, transformed in place by x -> m x + t and
+ * passed to wr. Buffers travel between the stages through lock-free rings.
+ * Each of streamread, streamcompute and streamwrite performs one step of
+ * its stage and returns 1 if it made progress, 0 if it has to wait for
+ * another stage and -1 once the stage is finished. The stages can be run
+ * from three threads or interleaved on one thread with streamrun. Set m to
+ * q4m33(q) to apply a quaternion rotation. count and secs hold points
+ * processed and time spent per stage. Time is measured with now, which
+ * defaults to a monotonic wall clock where the platform has one and to
+ * time otherwise; processor time would count every thread. streaminit
+ * returns 0 if there are no buffers.
+ */
+static inline double
+streamclock(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec + (double)ts.tv_nsec * 1e-9);
+#elif defined(TIME_UTC)
+	struct timespec ts;
+
+	timespec_get(&ts, TIME_UTC);
+	return ((double)ts.tv_sec + (double)ts.tv_nsec * 1e-9);
+#else
+	return ((double)time(NULL));
+#endif
+}
+
+static inline int
+streaminit(stream *s, v3 **bufs, size_t nbuf, size_t chunk,
+    streamreadfn rd, streamwritefn wr, void *arg)
+{
+	size_t i;
+
+	if (nbuf == 0)
+		return (0);
+	if (nbuf > LINALG_RINGSIZE)
+		nbuf = LINALG_RINGSIZE;
+	ringinit(&s->free);
+	ringinit(&s->full);
+	ringinit(&s->done);
+	for (i = 0; i < nbuf; i++) {
+		s->buf[i] = bufs[i];
+		s->len[i] = 0;
+		ringpush(&s->free, i);
+	}
+	s->nbuf = nbuf;
+	s->chunk = chunk;
+	s->m = m33ident();
+	s->t = v3zero();
+	s->rd = rd;
+	s->wr = wr;
+	s->now = streamclock;
+	s->arg = arg;
+	s->eof = 0;
+	s->fin = 0;
+	for (i = 0; i < 3; i++) {
+		s->count[i] = 0;
+		s->secs[i] = 0;
+	}
+	return (1);
+}
+
+static inline int
+streamread(stream *s)
+{
+	double c;
+	size_t b;
+
+	if (s->eof)
+		return (-1);
+	if (!ringpop(&s->free, &b))
+		return (0);
+	c = s->now();
+	s->len[b] = s->rd(s->arg, s->buf[b], s->chunk);
+	s->count[0] += s->len[b];
+	s->secs[0] += s->now() - c;
+	if (s->len[b] == 0) {
+		/* Only the writer pushes to free; the empty buffer is not
+		 * needed again. */
+		LINALG_STORE(&s->eof, 1);
+		return (-1);
+	}
+	ringpush(&s->full, b);
+	return (1);
+}
+
+static inline int
+streamcompute(stream *s)
+{
+	double c;
+	size_t b;
+
+	if (s->fin)
+		return (-1);
+	if (!ringpop(&s->full, &b)) {
+		if (!LINALG_LOAD(&s->eof))
+			return (0);
+		if (!ringpop(&s->full, &b)) {
+			LINALG_STORE(&s->fin, 1);
+			return (-1);
+		}
+	}
+	c = s->now();
+	v3xform(s->m, s->t, s->buf[b], s->buf[b], s->len[b]);
+	s->count[1] += s->len[b];
+	s->secs[1] += s->now() - c;
+	ringpush(&s->done, b);
+	return (1);
+}
+
+static inline int
+streamwrite(stream *s)
+{
+	double c;
+	size_t b;
+	int fin = LINALG_LOAD(&s->fin);
+
+	if (!ringpop(&s->done, &b))
+		return (fin ? -1 : 0);
+	c = s->now();
+	s->wr(s->arg, s->buf[b], s->len[b]);
+	s->count[2] += s->len[b];
+	s->secs[2] += s->now() - c;
+	ringpush(&s->free, b);
+	return (1);
+}
+
+static inline void
+streamrun(stream *s)
+{
+	while (streamwrite(s) >= 0) {
+		streamread(s);
+		streamcompute(s);
+	}
+}
+
+/*
+ * Smallest-three quaternion encoding. The largest component of a unit
+ * quaternion is dropped and recomputed on decoding; its index takes two
+ * bits and each of the other three components is stored in bits bits
+ * (at most 20), with zero exactly representable. With
+ * d = 1 / (sqrt(2) * (2^bits - 2)) the three stored components are within
+ * d of the input and the recomputed one within 3 d: d = 6.9e-4 for the
+ * 32-bit (10 bits) and 2.2e-5 for the 48-bit (15 bits) encoding. q and -q
+ * encode to the same value and NaN components encode as zero. The bulk
+ * functions work in blocks of LINALG_SOABLOCK quaternions with q4packblk
+ * and q4unpackblk, whose loops select rather than branch and vectorize;
+ * the square root in q4unpackblk only does without -fmath-errno.
+ */
+#ifndef LINALG_SOABLOCK
+#define LINALG_SOABLOCK 64
+#endif
+
+/* Encode n <= LINALG_SOABLOCK quaternions. */
+static inline void
+q4packblk(const q4 *q, uint64_t *v, size_t n, unsigned bits)
+{
+	real c[4][LINALG_SOABLOCK], a[4][LINALG_SOABLOCK];
+	real m = (real)((1UL << bits) - 2), h = (real)0.5 * m + (real)0.5;
+	real s = (real)0.70710678118654752440 * m, big, t;
+	size_t j;
+	unsigned k;
+
+	for (j = 0; j < n; j++) {
+		c[0][j] = q[j].w == q[j].w ? q[j].w : 0;
+		c[1][j] = q[j].x == q[j].x ? q[j].x : 0;
+		c[2][j] = q[j].y == q[j].y ? q[j].y : 0;
+		c[3][j] = q[j].z == q[j].z ? q[j].z : 0;
+	}
+	for (k = 0; k < 4; k++)
+		for (j = 0; j < n; j++)
+			a[k][j] = (real)fabs((double)c[k][j]);
+	/* a[3] becomes the index of the largest component. */
+	for (j = 0; j < n; j++) {
+		big = a[0][j];
+		t = a[1][j] > big ? 1 : 0;
+		big = a[1][j] > big ? a[1][j] : big;
+		t = a[2][j] > big ? 2 : t;
+		big = a[2][j] > big ? a[2][j] : big;
+		a[3][j] = a[3][j] > big ? 3 : t;
+	}
+	/* a[0] is the scale, negated if the largest component is negative. */
+	for (j = 0; j < n; j++) {
+		t = a[3][j] == 0 ? c[0][j] : c[1][j];
+		t = a[3][j] == 2 ? c[2][j] : t;
+		t = a[3][j] == 3 ? c[3][j] : t;
+		a[0][j] = t < 0 ? -s : s;
+	}
+	for (j = 0; j < n; j++) {
+		t = a[0][j];
+		a[0][j] = (a[3][j] == 0 ? c[1][j] : c[0][j]) * t + h;
+		a[1][j] = (a[3][j] <= 1 ? c[2][j] : c[1][j]) * t + h;
+		a[2][j] = (a[3][j] <= 2 ? c[3][j] : c[2][j]) * t + h;
+	}
+	for (k = 0; k < 3; k++)
+		for (j = 0; j < n; j++) {
+			t = a[k][j] > 0 ? a[k][j] : 0;
+			a[k][j] = t < m ? t : m;
+		}
+	for (j = 0; j < n; j++)
+		v[j] = (uint64_t)(int32_t)a[3][j] << (3 * bits) |
+		    (uint64_t)(int32_t)a[0][j] << (2 * bits) |
+		    (uint64_t)(int32_t)a[1][j] << bits | (uint64_t)(int32_t)a[2][j];
+}
+
+/* Decode n <= LINALG_SOABLOCK quaternions. */
+static inline void
+q4unpackblk(const uint64_t *v, q4 *q, size_t n, unsigned bits)
+{
+	real c[4][LINALG_SOABLOCK], d[4][LINALG_SOABLOCK], t;
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	real m = (real)(mask - 1), h = (real)0.70710678118654752440;
+	size_t j;
+	unsigned k;
+
+	for (j = 0; j < n; j++) {
+		d[3][j] = (real)(int32_t)(v[j] >> (3 * bits) & 3);
+		d[0][j] = (real)(int32_t)(v[j] >> (2 * bits) & mask);
+		d[1][j] = (real)(int32_t)(v[j] >> bits & mask);
+		d[2][j] = (real)(int32_t)(v[j] & mask);
+	}
+	for (k = 0; k < 3; k++)
+		for (j = 0; j < n; j++)
+			d[k][j] = (d[k][j] / m * 2 - 1) * h;
+	for (j = 0; j < n; j++) {
+		t = 1 - d[0][j] * d[0][j] - d[1][j] * d[1][j] -
+		    d[2][j] * d[2][j];
+		c[3][j] = t > 0 ? t : 0;
+	}
+	for (j = 0; j < n; j++)
+		c[3][j] = (real)sqrt((double)c[3][j]);
+	for (j = 0; j < n; j++) {
+		c[0][j] = d[3][j] == 0 ? c[3][j] : d[0][j];
+		t = d[3][j] == 1 ? c[3][j] : d[1][j];
+		c[1][j] = d[3][j] == 0 ? d[0][j] : t;
+		t = d[3][j] == 2 ? c[3][j] : d[2][j];
+		c[2][j] = d[3][j] <= 1 ? d[1][j] : t;
+		c[3][j] = d[3][j] == 3 ? c[3][j] : d[2][j];
+	}
+	for (j = 0; j < n; j++)
+		q[j] = q4new(c[0][j], c[1][j], c[2][j], c[3][j]);
+}
+
+static inline uint64_t
+q4pack(q4 q, unsigned bits)
+{
+	uint64_t v;
+
+	q4packblk(&q, &v, 1, bits);
+	return (v);
+}
+
+static inline q4
+q4unpack(uint64_t v, unsigned bits)
+{
+	q4 q;
+
+	q4unpackblk(&v, &q, 1, bits);
+	return (q);
+}
+
+static inline void
+q4enc32(const q4 *q, uint32_t *out, size_t n)
+{
+	uint64_t v[LINALG_SOABLOCK];
+	size_t i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i < LINALG_SOABLOCK ? n - i : LINALG_SOABLOCK;
+		q4packblk(q + i, v, m, 10);
+		for (j = 0; j < m; j++)
+			out[i + j] = (uint32_t)v[j];
+	}
+}
+
+static inline void
+q4dec32(const uint32_t *in, q4 *q, size_t n)
+{
+	uint64_t v[LINALG_SOABLOCK];
+	size_t i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i < LINALG_SOABLOCK ? n - i : LINALG_SOABLOCK;
+		for (j = 0; j < m; j++)
+			v[j] = in[i + j];
+		q4unpackblk(v, q + i, m, 10);
+	}
+}
+
+/* The 48-bit encoding is stored as three 16-bit words, high word first. */
+static inline void
+q4enc48(const q4 *q, uint16_t *out, size_t n)
+{
+	uint64_t v[LINALG_SOABLOCK];
+	size_t i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i < LINALG_SOABLOCK ? n - i : LINALG_SOABLOCK;
+		q4packblk(q + i, v, m, 15);
+		for (j = 0; j < m; j++) {
+			out[3 * (i + j) + 0] = (uint16_t)(v[j] >> 32);
+			out[3 * (i + j) + 1] = (uint16_t)(v[j] >> 16);
+			out[3 * (i + j) + 2] = (uint16_t)v[j];
+		}
+	}
+}
+
+static inline void
+q4dec48(const uint16_t *in, q4 *q, size_t n)
+{
+	uint64_t v[LINALG_SOABLOCK];
+	const uint16_t *p;
+	size_t i, j, m;
+
+	for (i = 0; i < n; i += m) {
+		m = n - i < LINALG_SOABLOCK ? n - i : LINALG_SOABLOCK;
+		for (j = 0; j < m; j++) {
+			p = in + 3 * (i + j);
+			v[j] = (uint64_t)p[0] << 32 | (uint64_t)p[1] << 16 |
+			    (uint64_t)p[2];
+		}
+		q4unpackblk(v, q + i, m, 15);
+	}
+}
+
+/*
+ * 16-bit fixed-point v3 encoding relative to a bounding box. Points are
+ * clamped to the box; inside it every component is within extent / 131070
+ * of the input along its axis. NaN components encode as the low corner.
+ * The clamps are selects, so both loops vectorize.
+ */
+static inline void
+v3encbox(box3 b, const v3 *v, uint16_t *out, size_t n)
+{
+	v3 e = box3extent(b), s;
+	real x, y, z;
+	size_t i;
+
+	s = v3new(e.x > 0 ? 65535 / e.x : 0, e.y > 0 ? 65535 / e.y : 0,
+	    e.z > 0 ? 65535 / e.z : 0);
+	for (i = 0; i < n; i++) {
+		x = (v[i].x - b.lo.x) * s.x + (real)0.5;
+		y = (v[i].y - b.lo.y) * s.y + (real)0.5;
+		z = (v[i].z - b.lo.z) * s.z + (real)0.5;
+		x = x > 0 ? x : 0;
+		y = y > 0 ? y : 0;
+		z = z > 0 ? z : 0;
+		x = x < 65535 ? x : 65535;
+		y = y < 65535 ? y : 65535;
+		z = z < 65535 ? z : 65535;
+		out[3 * i + 0] = (uint16_t)(int32_t)x;
+		out[3 * i + 1] = (uint16_t)(int32_t)y;
+		out[3 * i + 2] = (uint16_t)(int32_t)z;
+	}
+}
+
+static inline void
+v3decbox(box3 b, const uint16_t *in, v3 *v, size_t n)
+{
+	v3 s = v3div(box3extent(b), 65535);
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v[i] = v3add(b.lo, v3new(in[3 * i] * s.x, in[3 * i + 1] * s.y,
+		    in[3 * i + 2] * s.z));
+}
+
+/*
+ * IEEE 754 half precision with round to nearest even. Normal results
+ * (magnitude 6.1e-5 to 65504) have a relative error of at most 2^-11,
+ * smaller magnitudes an absolute error of at most 2^-25. Larger values
+ * become infinity.
+ */
+static inline uint16_t
+realtohalf(real r)
+{
+#ifdef LINALG_SINGLE_PRECISION
+	float f = r, magic;
+	uint32_t u, sign, m = (127 - 15 + 23 - 10 + 1) << 23;
+
+	memcpy(&magic, &m, sizeof(magic));
+	memcpy(&u, &f, sizeof(u));
+	sign = (u >> 16) & 0x8000;
+	u &= 0x7fffffff;
+	if (u >= (127 + 16) << 23)
+		return ((uint16_t)(sign | (u > 0x7f800000 ? 0x7e00 : 0x7c00)));
+	if (u < 113 << 23) {
+		memcpy(&f, &u, sizeof(f));
+		f += magic;
+		memcpy(&u, &f, sizeof(u));
+		return ((uint16_t)(sign | (u - m)));
+	}
+	u += ((uint32_t)(15 - 127) << 23) + 0xfff + ((u >> 13) & 1);
+	return ((uint16_t)(sign | (u >> 13)));
+#else
+	/* Round once from the double bits; going through float would round
+	 * twice. */
+	double f = r, magic;
+	uint64_t u, sign, m = (uint64_t)(1023 - 15 + 52 - 10 + 1) << 52;
+
+	memcpy(&magic, &m, sizeof(magic));
+	memcpy(&u, &f, sizeof(u));
+	sign = (u >> 48) & 0x8000;
+	u &= ((uint64_t)1 << 63) - 1;
+	if (u >= (uint64_t)(1023 + 16) << 52)
+		return ((uint16_t)(sign |
+		    (u > (uint64_t)0x7ff << 52 ? 0x7e00 : 0x7c00)));
+	if (u < (uint64_t)(1023 - 14) << 52) {
+		memcpy(&f, &u, sizeof(f));
+		f += magic;
+		memcpy(&u, &f, sizeof(u));
+		return ((uint16_t)(sign | (u - m)));
+	}
+	u += ((uint64_t)(15 - 1023) << 52) + (((uint64_t)1 << 41) - 1) +
+	    ((u >> 42) & 1);
+	return ((uint16_t)(sign | (u >> 42)));
+#endif
+}
+
+static inline real
+halftoreal(uint16_t h)
+{
+	uint32_t u = (uint32_t)(h & 0x7fff) << 13, e = u & (0x7c00 << 13);
+	uint32_t m = 113 << 23;
+	float f, magic;
+
+	u += (127 - 15) << 23;
+	if (e == 0x7c00 << 13) {
+		u += (128 - 16) << 23;
+	} else if (e == 0) {
+		u += 1 << 23;
+		memcpy(&f, &u, sizeof(f));
+		memcpy(&magic, &m, sizeof(magic));
+		f -= magic;
+		memcpy(&u, &f, sizeof(u));
+	}
+	u |= (uint32_t)(h & 0x8000) << 16;
+	memcpy(&f, &u, sizeof(f));
+	return ((real)f);
+}
+
+static inline void
+v3enchalf(const v3 *v, uint16_t *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		out[3 * i + 0] = realtohalf(v[i].x);
+		out[3 * i + 1] = realtohalf(v[i].y);
+		out[3 * i + 2] = realtohalf(v[i].z);
+	}
+}
+
+static inline void
+v3dechalf(const uint16_t *in, v3 *v, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v[i] = v3new(halftoreal(in[3 * i]), halftoreal(in[3 * i + 1]),
+		    halftoreal(in[3 * i + 2]));
+}
+
+/*
+ * Views over external arrays of reals. Component k of vector i of a v3view
+ * is p[i * stride + k * cstride]: interleaved xyz padded to four reals is
+ * (p, n, 4, 1), three separate x, y and z arrays of length n are
+ * (p, n, 1, n). Entry (r, c) of matrix i of an m33view is
+ * p[i * stride + r * rstride + c * cstride], with the row and column
+ * strides set from the layout flag. Strides are in units of real and may
+ * be negative.
+ */
+static inline v3view
+v3viewnew(real *p, size_t n, ptrdiff_t stride, ptrdiff_t cstride)
+{
+	v3view v = { p, n, stride, cstride };
+	return (v);
+}
+
+static inline v3
+v3viewget(v3view v, size_t i)
+{
+	const real *e = v.p + (ptrdiff_t)i * v.stride;
+	return v3new(e[0], e[v.cstride], e[2 * v.cstride]);
+}
+
+static inline void
+v3viewset(v3view v, size_t i, v3 a)
+{
+	real *e = v.p + (ptrdiff_t)i * v.stride;
+
+	e[0] = a.x;
+	e[v.cstride] = a.y;
+	e[2 * v.cstride] = a.z;
+}
+
+static inline m33view
+m33viewnew(real *p, size_t n, ptrdiff_t stride, int layout)
+{
+	m33view m;
+
+	m.p = p;
+	m.n = n;
+	m.stride = stride;
+	m.rstride = layout == LINALG_COLMAJOR ? 1 : 3;
+	m.cstride = layout == LINALG_COLMAJOR ? 3 : 1;
+	return (m);
+}
+
+static inline m33
+m33viewget(m33view m, size_t i)
+{
+	const real *e = m.p + (ptrdiff_t)i * m.stride;
+	ptrdiff_t r = m.rstride, c = m.cstride;
+
+	return m33new(e[0], e[c], e[2 * c],
+		      e[r], e[r + c], e[r + 2 * c],
+		      e[2 * r], e[2 * r + c], e[2 * r + 2 * c]);
+}
+
+static inline void
+m33viewset(m33view m, size_t i, m33 a)
+{
+	real *e = m.p + (ptrdiff_t)i * m.stride;
+	ptrdiff_t r = m.rstride, c = m.cstride;
+
+	e[0] = a.xx;
+	e[c] = a.xy;
+	e[2 * c] = a.xz;
+	e[r] = a.yx;
+	e[r + c] = a.yy;
+	e[r + 2 * c] = a.yz;
+	e[2 * r] = a.zx;
+	e[2 * r + c] = a.zy;
+	e[2 * r + 2 * c] = a.zz;
+}
+
+/* out = m in + t for every vector of a view. in and out may be the same. */
+static inline void
+v3viewxform(m33 m, v3 t, v3view in, v3view out)
+{
+	size_t i;
+
+	for (i = 0; i < in.n; i++)
+		v3viewset(out, i, v3add(m33v3(m, v3viewget(in, i)), t));
+}
+
+/* out[i] = m[i] in[i] */
+static inline void
+m33viewv3(m33view m, v3view in, v3view out)
+{
+	size_t i;
+
+	for (i = 0; i < in.n; i++)
+		v3viewset(out, i, m33v3(m33viewget(m, i), v3viewget(in, i)));
+}
+
+static inline box3
+v3viewbox(v3view v)
+{
+	box3 b = box3empty();
+	size_t i;
+
+	for (i = 0; i < v.n; i++)
+		b = box3add(b, v3viewget(v, i));
+	return (b);
+}
+
+static inline s33
+s33new(real xx, real yy, real zz, real xy, real xz, real yz)
+{
+	s33 s = { xx, yy, zz, xy, xz, yz };
+	return (s);
+}
+
+static inline s33
+s33ident(void)
+{
+	return s33new(1, 1, 1, 0, 0, 0);
+}
+
+static inline m33
+s33full(s33 s)
+{
+	return m33new(s.xx, s.xy, s.xz, s.xy, s.yy, s.yz, s.xz, s.yz, s.zz);
+}
+
+static inline s33
+m33sym(m33 m)
+{
+	return s33new(m.xx, m.yy, m.zz, (m.xy + m.yx) * (real)0.5,
+	    (m.xz + m.zx) * (real)0.5, (m.yz + m.zy) * (real)0.5);
+}
+
+static inline s33
+s33add(s33 a, s33 b)
+{
+	return s33new(a.xx + b.xx, a.yy + b.yy, a.zz + b.zz,
+		      a.xy + b.xy, a.xz + b.xz, a.yz + b.yz);
+}
+
+static inline s33
+s33mul(s33 s, real k)
+{
+	return s33new(s.xx * k, s.yy * k, s.zz * k,
+		      s.xy * k, s.xz * k, s.yz * k);
+}
+
+static inline v3
+s33v3(s33 s, v3 v)
+{
+	return v3new(s.xx * v.x + s.xy * v.y + s.xz * v.z,
+		     s.xy * v.x + s.yy * v.y + s.yz * v.z,
+		     s.xz * v.x + s.yz * v.y + s.zz * v.z);
+}
+
+static inline real
+s33trace(s33 s)
+{
+	return (s.xx + s.yy + s.zz);
+}
+
+static inline real
+s33det(s33 s)
+{
+	return (s.xx * (s.yy * s.zz - s.yz * s.yz) +
+		s.xy * (s.xz * s.yz - s.xy * s.zz) +
+		s.xz * (s.xy * s.yz - s.xz * s.yy));
+}
+
+static inline s33
+s33inv(s33 s)
+{
+	real cxx = s.yy * s.zz - s.yz * s.yz;
+	real cxy = s.xz * s.yz - s.xy * s.zz;
+	real cxz = s.xy * s.yz - s.xz * s.yy;
+	real d = s.xx * cxx + s.xy * cxy + s.xz * cxz;
+
+	return s33mul(s33new(cxx, s.xx * s.zz - s.xz * s.xz,
+	    s.xx * s.yy - s.xy * s.xy, cxy, cxz, s.xy * s.xz - s.xx * s.yz),
+	    (real)1.0 / d);
+}
+
+/* R S R^T */
+static inline s33
+s33congr(m33 r, s33 s)
+{
+	v3 a = s33v3(s, m33rowx(r));
+	v3 b = s33v3(s, m33rowy(r));
+	v3 c = s33v3(s, m33rowz(r));
+
+	return s33new(v3dot(m33rowx(r), a), v3dot(m33rowy(r), b),
+	    v3dot(m33rowz(r), c), v3dot(m33rowx(r), b),
+	    v3dot(m33rowx(r), c), v3dot(m33rowy(r), c));
+}
+
+/*
+ * Eigenvalues of s in ascending order and the corresponding unit
+ * eigenvectors as columns of vec, by cyclic Jacobi rotations.
+ */
+static inline void
+s33eigen(s33 s, v3 *val, m33 *vec)
+{
+	real a[3][3], v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+	real theta, t, c, sn, tau, g, h, apq;
+	unsigned it, p, q, r, k;
+
+	a[0][0] = s.xx; a[0][1] = s.xy; a[0][2] = s.xz;
+	a[1][0] = s.xy; a[1][1] = s.yy; a[1][2] = s.yz;
+	a[2][0] = s.xz; a[2][1] = s.yz; a[2][2] = s.zz;
+	for (it = 0; it < 50; it++) {
+		if (fabs((double)a[0][1]) + fabs((double)a[0][2]) +
+		    fabs((double)a[1][2]) <= 0)
+			break;
+		for (p = 0; p < 2; p++) {
+			for (q = p + 1; q < 3; q++) {
+				apq = a[p][q];
+				g = 100 * (real)fabs((double)apq);
+				if ((real)fabs((double)a[p][p]) + g ==
+				    (real)fabs((double)a[p][p]) &&
+				    (real)fabs((double)a[q][q]) + g ==
+				    (real)fabs((double)a[q][q])) {
+					a[p][q] = a[q][p] = 0;
+					continue;
+				}
+				theta = (a[q][q] - a[p][p]) / (2 * apq);
+				t = (real)(1.0 / (fabs((double)theta) +
+				    sqrt((double)(theta * theta + 1))));
+				t = theta < 0 ? -t : t;
+				c = (real)(1.0 / sqrt((double)(t * t + 1)));
+				sn = t * c;
+				tau = sn / (1 + c);
+				r = 3 - p - q;
+				g = a[r][p];
+				h = a[r][q];
+				a[r][p] = a[p][r] = g - sn * (h + g * tau);
+				a[r][q] = a[q][r] = h + sn * (g - h * tau);
+				a[p][p] -= t * apq;
+				a[q][q] += t * apq;
+				a[p][q] = a[q][p] = 0;
+				for (k = 0; k < 3; k++) {
+					g = v[k][p];
+					h = v[k][q];
+					v[k][p] = g - sn * (h + g * tau);
+					v[k][q] = h + sn * (g - h * tau);
+				}
+			}
+		}
+	}
+	for (p = 0; p < 2; p++) {
+		for (q = p + 1; q < 3; q++) {
+			if (a[q][q] < a[p][p]) {
+				t = a[p][p];
+				a[p][p] = a[q][q];
+				a[q][q] = t;
+				for (k = 0; k < 3; k++) {
+					t = v[k][p];
+					v[k][p] = v[k][q];
+					v[k][q] = t;
+				}
+			}
+		}
+	}
+	*val = v3new(a[0][0], a[1][1], a[2][2]);
+	*vec = m33new(v[0][0], v[0][1], v[0][2],
+		      v[1][0], v[1][1], v[1][2],
+		      v[2][0], v[2][1], v[2][2]);
+}
+
+static inline int
+s33eq(s33 a, s33 b, real eps)
+{
+	if (!realeq(a.xx, b.xx, eps)) return (0);
+	if (!realeq(a.yy, b.yy, eps)) return (0);
+	if (!realeq(a.zz, b.zz, eps)) return (0);
+	if (!realeq(a.xy, b.xy, eps)) return (0);
+	if (!realeq(a.xz, b.xz, eps)) return (0);
+	if (!realeq(a.yz, b.yz, eps)) return (0);
+	return (1);
+}
+
+static inline void
+s33v3n(const s33 *s, const v3 *v, v3 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = s33v3(s[i], v[i]);
+}
+
+static inline void
+s33detn(const s33 *s, real *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = s33det(s[i]);
+}
+
+static inline void
+s33invn(const s33 *s, s33 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = s33inv(s[i]);
+}
+
+static inline void
+s33congrn(const m33 *r, const s33 *s, s33 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = s33congr(r[i], s[i]);
+}
+
+static inline void
+s33eigenn(const s33 *s, v3 *val, m33 *vec, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		s33eigen(s[i], &val[i], &vec[i]);
+}
+
+static inline af3
+af3new(m33 m, v3 t)
+{
+	af3 a = { m, t };
+	return (a);
+}
+
+static inline af3
+af3ident(void)
+{
+	return af3new(m33ident(), v3zero());
+}
+
+/* The transform that applies a first and then b. */
+static inline af3
+af3then(af3 a, af3 b)
+{
+	return af3new(m33m33(b.m, a.m), v3add(m33v3(b.m, a.t), b.t));
+}
+
+static inline v3
+af3v3(af3 a, v3 v)
+{
+	return v3add(m33v3(a.m, v), a.t);
+}
+
+/*
+ * Transform chains. Steps are recorded without touching any data and are
+ * folded into a single affine transform when the chain is applied, so a
+ * chain of any length costs one pass over the points. The step functions
+ * return zero if the chain already holds LINALG_CHAINMAX steps.
+ */
+static inline void
+chain3init(chain3 *c)
+{
+	c->n = 0;
+}
+
+static inline int
+chain3push(chain3 *c, af3 a)
+{
+	if (c->n == LINALG_CHAINMAX)
+		return (0);
+	c->step[c->n++] = a;
+	return (1);
+}
+
+static inline int
+chain3m33(chain3 *c, m33 m)
+{
+	return chain3push(c, af3new(m, v3zero()));
+}
+
+static inline int
+chain3q4(chain3 *c, q4 q)
+{
+	return chain3push(c, af3new(q4m33(q), v3zero()));
+}
+
+static inline int
+chain3scale(chain3 *c, real s)
+{
+	return chain3push(c, af3new(m33mul(m33ident(), s), v3zero()));
+}
+
+static inline int
+chain3move(chain3 *c, v3 t)
+{
+	return chain3push(c, af3new(m33ident(), t));
+}
+
+static inline af3
+chain3fold(const chain3 *c)
+{
+	af3 a = af3ident();
+	size_t i;
+
+	for (i = 0; i < c->n; i++)
+		a = af3then(a, c->step[i]);
+	return (a);
+}
+
+static inline void
+chain3apply(const chain3 *c, const v3 *in, v3 *out, size_t n)
+{
+	af3 a = chain3fold(c);
+
+	v3xform(a.m, a.t, in, out, n);
+}
+
+/*
+ * Space-filling curve keys of points inside a box. Every coordinate is
+ * quantized to bits bits, clamped to 1 to 21, giving 3 * bits bit keys:
+ * 30-bit keys for bits = 10 and 63-bit keys for bits = 21. Points outside
+ * the box are clamped to it.
+ */
+static inline uint64_t
+bitspread3(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | x << 32) & UINT64_C(0x1f00000000ffff);
+	x = (x | x << 16) & UINT64_C(0x1f0000ff0000ff);
+	x = (x | x << 8) & UINT64_C(0x100f00f00f00f00f);
+	x = (x | x << 4) & UINT64_C(0x10c30c30c30c30c3);
+	x = (x | x << 2) & UINT64_C(0x1249249249249249);
+	return (x);
+}
+
+static inline unsigned
+keybits(unsigned bits)
+{
+	return (bits < 1 ? 1 : bits > 21 ? 21 : bits);
+}
+
+static inline void
+v3quant(box3 b, v3 v, unsigned bits, uint64_t *q)
+{
+	v3 e = box3extent(b), p = v3sub(v, b.lo);
+	real m = (real)(((uint64_t)1 << keybits(bits)) - 1), x;
+	unsigned k;
+
+	for (k = 0; k < 3; k++) {
+		x = v3idx(e, k) > 0 ? v3idx(p, k) / v3idx(e, k) * m : 0;
+		x = x < 0 ? 0 : x > m ? m : x;
+		q[k] = (uint64_t)x;
+	}
+}
+
+static inline uint64_t
+v3morton(box3 b, v3 v, unsigned bits)
+{
+	uint64_t q[3];
+
+	v3quant(b, v, bits, q);
+	return (bitspread3(q[0]) << 2 | bitspread3(q[1]) << 1 |
+	    bitspread3(q[2]));
+}
+
+/* Hilbert key by Skilling's transpose algorithm. */
+static inline uint64_t
+v3hilbert(box3 b, v3 v, unsigned bits)
+{
+	uint64_t x[3], m = (uint64_t)1 << (keybits(bits) - 1), p, q, t;
+	unsigned i;
+
+	v3quant(b, v, bits, x);
+	for (q = m; q > 1; q >>= 1) {
+		p = q - 1;
+		for (i = 0; i < 3; i++) {
+			if (x[i] & q) {
+				x[0] ^= p;
+			} else {
+				t = (x[0] ^ x[i]) & p;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+	x[1] ^= x[0];
+	x[2] ^= x[1];
+	t = 0;
+	for (q = m; q > 1; q >>= 1)
+		if (x[2] & q)
+			t ^= q - 1;
+	for (i = 0; i < 3; i++)
+		x[i] ^= t;
+	return (bitspread3(x[0]) << 2 | bitspread3(x[1]) << 1 |
+	    bitspread3(x[2]));
+}
+
+static inline void
+v3mortonn(box3 b, const v3 *v, uint64_t *key, size_t n, unsigned bits)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		key[i] = v3morton(b, v[i], bits);
+}
+
+static inline void
+v3hilbertn(box3 b, const v3 *v, uint64_t *key, size_t n, unsigned bits)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		key[i] = v3hilbert(b, v[i], bits);
+}
+
+/*
+ * Stable LSD radix sort of keys with 8-bit digits. perm receives the
+ * original index of every sorted key. tkey and tperm are scratch arrays of
+ * n elements. Digits that are equal in all keys are skipped. A pass over
+ * the digit at shift is split in three like the reductions so that threads
+ * can share it: keyhist counts the digits of the keys in [i0, i1) into the
+ * 256 entries of cnt, keyscan turns nchunk such histograms of consecutive
+ * ranges, stored one after the other, into the output offset of every
+ * digit of every range, and keyscatter moves the keys and indices of a
+ * range to kb and pb from its offsets. keyhist and keyscatter can run on
+ * the ranges in any order or on any number of threads. keyscan returns 0
+ * if all keys share the digit and the pass can be skipped.
+ */
+static inline void
+keyhist(const uint64_t *key, size_t i0, size_t i1, unsigned shift,
+    size_t *cnt)
+{
+	size_t i, d;
+
+	for (d = 0; d < 256; d++)
+		cnt[d] = 0;
+	for (i = i0; i < i1; i++)
+		cnt[key[i] >> shift & 0xff]++;
+}
+
+static inline int
+keyscan(size_t *cnt, size_t nchunk)
+{
+	size_t c, d, s = 0, t, b, max = 0;
+
+	for (d = 0; d < 256; d++) {
+		for (c = 0, b = s; c < nchunk; c++) {
+			t = cnt[256 * c + d];
+			cnt[256 * c + d] = s;
+			s += t;
+		}
+		if (s - b > max)
+			max = s - b;
+	}
+	return (max < s);
+}
+
+static inline void
+keyscatter(const uint64_t *ka, const size_t *pa, size_t i0, size_t i1,
+    unsigned shift, size_t *cnt, uint64_t *kb, size_t *pb)
+{
+	size_t i, d;
+
+	for (i = i0; i < i1; i++) {
+		d = cnt[ka[i] >> shift & 0xff]++;
+		kb[d] = ka[i];
+		pb[d] = pa[i];
+	}
+}
+
+static inline void
+keysort(uint64_t *key, size_t *perm, size_t n, uint64_t *tkey,
+    size_t *tperm)
+{
+	uint64_t all = n ? key[0] : 0, any = 0, *ka = key, *kb = tkey, *kt;
+	size_t cnt[256], i, *pa = perm, *pb = tperm, *pt;
+	unsigned shift;
+
+	for (i = 0; i < n; i++) {
+		perm[i] = i;
+		all &= key[i];
+		any |= key[i];
+	}
+	for (shift = 0; shift < 64; shift += 8) {
+		if (((all ^ any) >> shift & 0xff) == 0)
+			continue;
+		keyhist(ka, 0, n, shift, cnt);
+		keyscan(cnt, 1);
+		keyscatter(ka, pa, 0, n, shift, cnt, kb, pb);
+		kt = ka, ka = kb, kb = kt;
+		pt = pa, pa = pb, pb = pt;
+	}
+	if (ka != key) {
+		memcpy(key, ka, n * sizeof(*key));
+		memcpy(perm, pa, n * sizeof(*perm));
+	}
+}
+
+/* out[i] = in[perm[i]] */
+static inline void
+v3permute(const v3 *in, const size_t *perm, v3 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = in[perm[i]];
+}
+
+/* out[perm[i]] = in[i], undoing v3permute */
+static inline void
+v3unpermute(const v3 *in, const size_t *perm, v3 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[perm[i]] = in[i];
+}
+
+/* v3permute for payload elements of size bytes */
+static inline void
+mempermute(const void *in, size_t size, const size_t *perm, void *out,
+    size_t n)
+{
+	const unsigned char *src = (const unsigned char *)in;
+	unsigned char *dst = (unsigned char *)out;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		memcpy(dst + i * size, src + perm[i] * size, size);
+}
+
+static inline void
+memunpermute(const void *in, size_t size, const size_t *perm, void *out,
+    size_t n)
+{
+	const unsigned char *src = (const unsigned char *)in;
+	unsigned char *dst = (unsigned char *)out;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		memcpy(dst + perm[i] * size, src + i * size, size);
+}
+
+/*
+ * Static kd-tree over a point array. The tree is implicit: the node of the
+ * range [lo, hi) is the median element lo + (hi - lo) / 2, split along
+ * the axis of the largest extent of the range, and its children are the
+ * ranges on either side. kd3build reorders p in place into tree order,
+ * stores the original index of every point in idx and the split axes in
+ * axis, so the whole tree is three flat arrays of n elements. Queries
+ * return original indices.
+ */
+static inline void
+kd3swap(v3 *p, size_t *idx, size_t i, size_t j)
+{
+	v3 t = p[i];
+	size_t k = idx[i];
+
+	p[i] = p[j];
+	p[j] = t;
+	idx[i] = idx[j];
+	idx[j] = k;
+}
+
+static inline void
+kd3select(v3 *p, size_t *idx, size_t lo, size_t hi, size_t k, unsigned ax)
+{
+	size_t lt, gt, i;
+	real piv, x;
+
+	while (hi - lo > 1) {
+		piv = v3idx(p[lo + (hi - lo) / 2], ax);
+		lt = i = lo;
+		gt = hi;
+		while (i < gt) {
+			x = v3idx(p[i], ax);
+			if (x < piv)
+				kd3swap(p, idx, lt++, i++);
+			else if (x > piv)
+				kd3swap(p, idx, i, --gt);
+			else
+				i++;
+		}
+		if (k < lt)
+			hi = lt;
+		else if (k >= gt)
+			lo = gt;
+		else
+			return;
+	}
+}
+
+static inline void
+kd3buildr(kd3 *t, size_t lo, size_t hi)
+{
+	size_t mid = lo + (hi - lo) / 2;
+	v3 e;
+	unsigned ax;
+
+	if (lo >= hi)
+		return;
+	e = box3extent(box3of(t->p + lo, hi - lo));
+	ax = e.x >= e.y && e.x >= e.z ? 0 : e.y >= e.z ? 1 : 2;
+	kd3select(t->p, t->idx, lo, hi, mid, ax);
+	t->axis[mid] = (unsigned char)ax;
+	kd3buildr(t, lo, mid);
+	kd3buildr(t, mid + 1, hi);
+}
+
+static inline kd3
+kd3build(v3 *p, size_t *idx, unsigned char *axis, size_t n)
+{
+	kd3 t;
+	size_t i;
+
+	t.p = p;
+	t.idx = idx;
+	t.axis = axis;
+	t.n = n;
+	for (i = 0; i < n; i++)
+		idx[i] = i;
+	kd3buildr(&t, 0, n);
+	return (t);
+}
+
+/* Insert a candidate into the k best found so far, sorted by distance. */
+static inline void
+kd3keep(size_t *out, real *d2, size_t *cnt, size_t k, size_t i, real d)
+{
+	size_t j;
+
+	if (*cnt == k && d >= d2[k - 1])
+		return;
+	j = *cnt < k ? (*cnt)++ : k - 1;
+	for (; j > 0 && d2[j - 1] > d; j--) {
+		out[j] = out[j - 1];
+		d2[j] = d2[j - 1];
+	}
+	out[j] = i;
+	d2[j] = d;
+}
+
+static inline void
+kd3knnr(const kd3 *t, size_t lo, size_t hi, v3 q, size_t k, size_t *out,
+    real *d2, size_t *cnt)
+{
+	size_t mid = lo + (hi - lo) / 2;
+	unsigned ax;
+	real diff;
+
+	if (lo >= hi)
+		return;
+	ax = t->axis[mid];
+	diff = v3idx(q, ax) - v3idx(t->p[mid], ax);
+	kd3keep(out, d2, cnt, k, t->idx[mid], v3distsq(q, t->p[mid]));
+	if (diff < 0)
+		kd3knnr(t, lo, mid, q, k, out, d2, cnt);
+	else
+		kd3knnr(t, mid + 1, hi, q, k, out, d2, cnt);
+	if (*cnt < k || diff * diff < d2[k - 1]) {
+		if (diff < 0)
+			kd3knnr(t, mid + 1, hi, q, k, out, d2, cnt);
+		else
+			kd3knnr(t, lo, mid, q, k, out, d2, cnt);
+	}
+}
+
+/* Find the k points nearest to q. out and d2 receive their indices and
+ * squared distances in increasing order. Returns the number found. */
+static inline size_t
+kd3knn(const kd3 *t, v3 q, size_t k, size_t *out, real *d2)
+{
+	size_t cnt = 0;
+
+	if (k > 0)
+		kd3knnr(t, 0, t->n, q, k, out, d2, &cnt);
+	return (cnt);
+}
+
+static inline size_t
+kd3nearest(const kd3 *t, v3 q, real *d2)
+{
+	size_t i = (size_t)-1;
+
+	kd3knn(t, q, 1, &i, d2);
+	return (i);
+}
+
+static inline void
+kd3radiusr(const kd3 *t, size_t lo, size_t hi, v3 q, real r2, size_t *out,
+    size_t max, size_t *cnt)
+{
+	size_t mid = lo + (hi - lo) / 2;
+	unsigned ax;
+	real diff;
+
+	if (lo >= hi)
+		return;
+	ax = t->axis[mid];
+	diff = v3idx(q, ax) - v3idx(t->p[mid], ax);
+	if (v3distsq(q, t->p[mid]) <= r2) {
+		if (*cnt < max)
+			out[*cnt] = t->idx[mid];
+		(*cnt)++;
+	}
+	if (diff <= 0 || diff * diff <= r2)
+		kd3radiusr(t, lo, mid, q, r2, out, max, cnt);
+	if (diff >= 0 || diff * diff <= r2)
+		kd3radiusr(t, mid + 1, hi, q, r2, out, max, cnt);
+}
+
+/* Find the points within distance r of q. Up to max indices are stored in
+ * out; the total number of points found is returned. */
+static inline size_t
+kd3radius(const kd3 *t, v3 q, real r, size_t *out, size_t max)
+{
+	size_t cnt = 0;
+
+	kd3radiusr(t, 0, t->n, q, r * r, out, max, &cnt);
+	return (cnt);
+}
+
+/* Nearest neighbors of n queries. Queries that are close in space reuse
+ * the same tree nodes, so ordering them along a space-filling curve first
+ * (v3hilbertn, keysort) improves cache behavior. */
+static inline void
+kd3nearestn(const kd3 *t, const v3 *q, size_t n, size_t *out, real *d2)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = kd3nearest(t, q[i], &d2[i]);
+}
+
+/*
+ * Mixed-precision solves. The system is stored in real, which is float
+ * with LINALG_SINGLE_PRECISION, and solved with m22solve or m33solve; that
+ * solution is iteration 0. Each further iteration computes the residual
+ * of the stored system in double precision, solves for the correction
+ * with m22solve or m33solve and adds it to the solution, which is kept in
+ * double precision and stored in x. Iteration stops when the largest
+ * residual component drops to tol times the largest component of b or
+ * after maxit corrections, so maxit = 0 returns the single solve. If info
+ * is not NULL it receives the number of corrections, the final relative
+ * residual and whether tol was reached. With float storage this gives
+ * double accurate solutions of the stored system for condition numbers
+ * well below 1 / FLT_EPSILON; in double precision the first solve is
+ * usually accurate already.
+ */
+static inline void
+m22solveir(m22 a, v2 b, double *x, unsigned maxit, double tol,
+    irinfo *info)
+{
+	double r[2], bn, rn;
+	v2 c = m22solve(a, b);
+	unsigned it;
+
+	bn = fabs((double)b.x) > fabs((double)b.y) ?
+	    fabs((double)b.x) : fabs((double)b.y);
+	x[0] = c.x;
+	x[1] = c.y;
+	for (it = 0;; it++) {
+		r[0] = (double)b.x - ((double)a.xx * x[0] + (double)a.xy * x[1]);
+		r[1] = (double)b.y - ((double)a.yx * x[0] + (double)a.yy * x[1]);
+		rn = fabs(r[0]) > fabs(r[1]) ? fabs(r[0]) : fabs(r[1]);
+		if (rn <= tol * bn || it == maxit)
+			break;
+		c = m22solve(a, v2new((real)r[0], (real)r[1]));
+		x[0] += (double)c.x;
+		x[1] += (double)c.y;
+	}
+	if (info) {
+		info->iters = it;
+		info->res = bn > 0 ? rn / bn : rn;
+		info->ok = rn <= tol * bn;
+	}
+}
+
+static inline void
+m33solveir(m33 a, v3 b, double *x, unsigned maxit, double tol,
+    irinfo *info)
+{
+	double m[9] = { a.xx, a.xy, a.xz, a.yx, a.yy, a.yz, a.zx, a.zy, a.zz };
+	double bb[3] = { b.x, b.y, b.z }, r[3], bn = 0, rn;
+	v3 c = m33solve(a, b);
+	unsigned it, i;
+
+	for (i = 0; i < 3; i++)
+		bn = fabs(bb[i]) > bn ? fabs(bb[i]) : bn;
+	x[0] = c.x;
+	x[1] = c.y;
+	x[2] = c.z;
+	for (it = 0;; it++) {
+		rn = 0;
+		for (i = 0; i < 3; i++) {
+			r[i] = bb[i] - (m[3 * i] * x[0] + m[3 * i + 1] * x[1] +
+			    m[3 * i + 2] * x[2]);
+			rn = fabs(r[i]) > rn ? fabs(r[i]) : rn;
+		}
+		if (rn <= tol * bn || it == maxit)
+			break;
+		c = m33solve(a, v3new((real)r[0], (real)r[1], (real)r[2]));
+		x[0] += (double)c.x;
+		x[1] += (double)c.y;
+		x[2] += (double)c.z;
+	}
+	if (info) {
+		info->iters = it;
+		info->res = bn > 0 ? rn / bn : rn;
+		info->ok = rn <= tol * bn;
+	}
+}
+
+/* Batched solves; x holds 2 n or 3 n doubles. */
+static inline void
+m22solveirn(const m22 *a, const v2 *b, double *x, irinfo *info, size_t n,
+    unsigned maxit, double tol)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m22solveir(a[i], b[i], x + 2 * i, maxit, tol,
+		    info ? &info[i] : NULL);
+}
+
+static inline void
+m33solveirn(const m33 *a, const v3 *b, double *x, irinfo *info, size_t n,
+    unsigned maxit, double tol)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m33solveir(a[i], b[i], x + 3 * i, maxit, tol,
+		    info ? &info[i] : NULL);
+}
+
+/*
+ * Scatter-add into a shared array from several threads. The atomic adds
+ * retry a compare-and-swap per component until it succeeds. A scat3
+ * buffer collects (index, value) pairs privately, so each thread touches
+ * the shared array only when flushing. colorgreedy splits elements, given
+ * as k target indices each, into colors whose elements touch disjoint
+ * entries; the elements of one color can then be added without any
+ * synchronization. Atomic adds require a GCC-compatible compiler and are
+ * plain adds elsewhere.
+ */
+static inline void
+realatomicadd(real *p, real v)
+{
+#if defined(__GNUC__)
+	real o, n;
+
+	__atomic_load(p, &o, __ATOMIC_RELAXED);
+	do {
+		n = o + v;
+	} while (!__atomic_compare_exchange(p, &o, &n, 1, __ATOMIC_RELAXED,
+	    __ATOMIC_RELAXED));
+#else
+	*p += v;
+#endif
+}
+
+static inline void
+v3atomicadd(v3 *p, v3 v)
+{
+	realatomicadd(&p->x, v.x);
+	realatomicadd(&p->y, v.y);
+	realatomicadd(&p->z, v.z);
+}
+
+static inline void
+m33atomicadd(m33 *p, m33 m)
+{
+	realatomicadd(&p->xx, m.xx);
+	realatomicadd(&p->xy, m.xy);
+	realatomicadd(&p->xz, m.xz);
+	realatomicadd(&p->yx, m.yx);
+	realatomicadd(&p->yy, m.yy);
+	realatomicadd(&p->yz, m.yz);
+	realatomicadd(&p->zx, m.zx);
+	realatomicadd(&p->zy, m.zy);
+	realatomicadd(&p->zz, m.zz);
+}
+
+static inline void
+scat3init(scat3 *s, size_t *idx, v3 *val, size_t cap)
+{
+	s->idx = idx;
+	s->val = val;
+	s->n = 0;
+	s->cap = cap;
+}
+
+/* Returns 0 if the buffer is full. An add to the same index as the
+ * previous one is combined with it; other repeated indices get separate
+ * entries, which the flush adds in turn. */
+static inline int
+scat3add(scat3 *s, size_t i, v3 v)
+{
+	if (s->n > 0 && s->idx[s->n - 1] == i) {
+		s->val[s->n - 1] = v3add(s->val[s->n - 1], v);
+		return (1);
+	}
+	if (s->n == s->cap)
+		return (0);
+	s->idx[s->n] = i;
+	s->val[s->n] = v;
+	s->n++;
+	return (1);
+}
+
+/* Add the buffered values to out and empty the buffer. Only one thread may
+ * write to out at a time. */
+static inline void
+scat3flush(scat3 *s, v3 *out)
+{
+	size_t i;
+
+	for (i = 0; i < s->n; i++)
+		out[s->idx[i]] = v3add(out[s->idx[i]], s->val[i]);
+	s->n = 0;
+}
+
+static inline void
+scat3flushatomic(scat3 *s, v3 *out)
+{
+	size_t i;
+
+	for (i = 0; i < s->n; i++)
+		v3atomicadd(&out[s->idx[i]], s->val[i]);
+	s->n = 0;
+}
+
+/* Color n elements with k target indices each in conn, giving every
+ * element the lowest color not yet used at any of its targets. Colors are
+ * tried in windows of 64 with one bit per color in mask, which holds nnode
+ * entries of scratch space. Returns the number of colors. */
+static inline size_t
+colorgreedy(const size_t *conn, size_t k, size_t n, size_t nnode,
+    uint64_t *mask, size_t *color)
+{
+	size_t i, j, b, base, left = n, nc = 0;
+	uint64_t m;
+
+	for (i = 0; i < n; i++)
+		color[i] = (size_t)-1;
+	for (base = 0; left > 0; base += 64) {
+		for (i = 0; i < nnode; i++)
+			mask[i] = 0;
+		for (i = 0; i < n; i++) {
+			if (color[i] != (size_t)-1)
+				continue;
+			for (j = 0, m = 0; j < k; j++)
+				m |= mask[conn[i * k + j]];
+			if (m == ~(uint64_t)0)
+				continue;
+			for (b = 0; m & ((uint64_t)1 << b); b++)
+				continue;
+			for (j = 0; j < k; j++)
+				mask[conn[i * k + j]] |= (uint64_t)1 << b;
+			color[i] = base + b;
+			nc = base + b + 1 > nc ? base + b + 1 : nc;
+			left--;
+		}
+	}
+	return (nc);
+}
+
+/* Order elements by color. Elements of color c are order[start[c]] to
+ * order[start[c + 1] - 1]; start holds ncolor + 1 entries. */
+static inline void
+colorgroup(const size_t *color, size_t n, size_t ncolor, size_t *start,
+    size_t *order)
+{
+	size_t i;
+
+	for (i = 0; i <= ncolor; i++)
+		start[i] = 0;
+	for (i = 0; i < n; i++)
+		start[color[i] + 1]++;
+	for (i = 0; i < ncolor; i++)
+		start[i + 1] += start[i];
+	for (i = 0; i < n; i++)
+		order[start[color[i]]++] = i;
+	for (i = ncolor; i > 0; i--)
+		start[i] = start[i - 1];
+	start[0] = 0;
+}
+
+/*
+ * Batched determinants and inverses of matrices in structure of arrays
+ * form. The inverses work in blocks of LINALG_SOABLOCK matrices: a loop
+ * without branches or stores through the caller's pointers computes a
+ * block into local arrays, so compilers vectorize it across matrices, and
+ * short loops then copy the results out. rcond is the reciprocal
+ * condition number in the 1-norm, exact for these sizes since the
+ * adjugate is formed anyway. A matrix is singular if its determinant
+ * is zero or rcond is below tol or not a number; its inverse and rcond
+ * are set to zero and its flag in sing is set. det, rcond and sing may
+ * be NULL. The inverse may overwrite the input. The inverse functions
+ * return the number of singular matrices.
+ */
+/* Store a block of m results starting at matrix j. Rows 0 to k - 1 of b
+ * hold the inverse entries, row k the determinants, row k + 1 the rcond
+ * values and row k + 2 is 1 for regular matrices. Returns the number of
+ * singular ones. */
+static inline size_t
+invsoaput(real *const *o, size_t k, real (*b)[LINALG_SOABLOCK], size_t j,
+    size_t m, real *det, real *rcond, unsigned char *sing)
+{
+	const real *ok = b[k + 2];
+	size_t i, l, ns = 0;
+	real v;
+
+	/* A nonzero matrix with a zero determinant has rcond 0, which a zero
+	 * tol would accept. */
+	for (i = 0; i < m; i++) {
+		v = b[k + 2][i];
+		b[k + 2][i] = b[k][i] != 0 ? v : 0;
+	}
+	for (l = 0; l < k; l++) {
+		for (i = 0; i < m; i++) {
+			v = b[l][i];
+			o[l][j + i] = ok[i] != 0 ? v : 0;
+		}
+	}
+	if (det)
+		memcpy(det + j, b[k], m * sizeof(real));
+	for (i = 0; rcond && i < m; i++) {
+		v = b[k + 1][i];
+		rcond[j + i] = ok[i] != 0 ? v : 0;
+	}
+	for (i = 0; sing && i < m; i++)
+		sing[j + i] = (unsigned char)(ok[i] == 0);
+	for (i = 0; i < m; i++)
+		ns += (size_t)(ok[i] == 0);
+	return (ns);
+}
+
+static inline void
+m22detsoa(m22soa a, real *det, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		det[i] = a.xx[i] * a.yy[i] - a.xy[i] * a.yx[i];
+}
+
+static inline size_t
+m22invsoa(m22soa a, m22soa inv, real *det, real *rcond, unsigned char *sing,
+    size_t n, real tol)
+{
+	real xx, xy, yx, yy, d, s, r, b[7][LINALG_SOABLOCK];
+	real *o[4];
+	size_t i, j, m, ns = 0;
+
+	o[0] = inv.xx;
+	o[1] = inv.xy;
+	o[2] = inv.yx;
+	o[3] = inv.yy;
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		for (i = 0; i < m; i++) {
+			xx = a.xx[j + i];
+			xy = a.xy[j + i];
+			yx = a.yx[j + i];
+			yy = a.yy[j + i];
+			d = xx * yy - xy * yx;
+			s = 1 / d;
+			r = 1 / (realabs(s) *
+			    realmax(realabs(xx) + realabs(yx),
+				    realabs(xy) + realabs(yy)) *
+			    realmax(realabs(yy) + realabs(yx),
+				    realabs(xy) + realabs(xx)));
+			b[0][i] = yy * s;
+			b[1][i] = -xy * s;
+			b[2][i] = -yx * s;
+			b[3][i] = xx * s;
+			b[4][i] = d;
+			b[5][i] = r;
+			b[6][i] = r >= tol;
+		}
+		ns += invsoaput(o, 4, b, j, m, det, rcond, sing);
+	}
+	return (ns);
+}
+
+static inline void
+m33detsoa(m33soa a, real *det, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		det[i] = a.xx[i] * (a.yy[i] * a.zz[i] - a.yz[i] * a.zy[i]) +
+		    a.xy[i] * (a.yz[i] * a.zx[i] - a.yx[i] * a.zz[i]) +
+		    a.xz[i] * (a.yx[i] * a.zy[i] - a.yy[i] * a.zx[i]);
+}
+
+static inline size_t
+m33invsoa(m33soa a, m33soa inv, real *det, real *rcond, unsigned char *sing,
+    size_t n, real tol)
+{
+	real xx, xy, xz, yx, yy, yz, zx, zy, zz;
+	real cxx, cxy, cxz, cyx, cyy, cyz, czx, czy, czz;
+	real d, na, nc, s, r, b[12][LINALG_SOABLOCK];
+	real *o[9];
+	size_t i, j, m, ns = 0;
+
+	o[0] = inv.xx;
+	o[1] = inv.xy;
+	o[2] = inv.xz;
+	o[3] = inv.yx;
+	o[4] = inv.yy;
+	o[5] = inv.yz;
+	o[6] = inv.zx;
+	o[7] = inv.zy;
+	o[8] = inv.zz;
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		for (i = 0; i < m; i++) {
+			xx = a.xx[j + i];
+			xy = a.xy[j + i];
+			xz = a.xz[j + i];
+			yx = a.yx[j + i];
+			yy = a.yy[j + i];
+			yz = a.yz[j + i];
+			zx = a.zx[j + i];
+			zy = a.zy[j + i];
+			zz = a.zz[j + i];
+			cxx = yy * zz - yz * zy;
+			cxy = zy * xz - zz * xy;
+			cxz = xy * yz - xz * yy;
+			cyx = yz * zx - yx * zz;
+			cyy = zz * xx - zx * xz;
+			cyz = xz * yx - xx * yz;
+			czx = yx * zy - yy * zx;
+			czy = zx * xy - zy * xx;
+			czz = xx * yy - xy * yx;
+			d = xx * cxx + xy * cyx + xz * czx;
+			na = realmax(realmax(realabs(xx) + realabs(yx) +
+			    realabs(zx), realabs(xy) + realabs(yy) +
+			    realabs(zy)), realabs(xz) + realabs(yz) +
+			    realabs(zz));
+			nc = realmax(realmax(realabs(cxx) + realabs(cyx) +
+			    realabs(czx), realabs(cxy) + realabs(cyy) +
+			    realabs(czy)), realabs(cxz) + realabs(cyz) +
+			    realabs(czz));
+			s = 1 / d;
+			r = 1 / (realabs(s) * na * nc);
+			b[0][i] = cxx * s;
+			b[1][i] = cxy * s;
+			b[2][i] = cxz * s;
+			b[3][i] = cyx * s;
+			b[4][i] = cyy * s;
+			b[5][i] = cyz * s;
+			b[6][i] = czx * s;
+			b[7][i] = czy * s;
+			b[8][i] = czz * s;
+			b[9][i] = d;
+			b[10][i] = r;
+			b[11][i] = r >= tol;
+		}
+		ns += invsoaput(o, 9, b, j, m, det, rcond, sing);
+	}
+	return (ns);
+}
+
+/*
+ * Orientation integration. Angular velocities w are in the world frame, so
+ * a step is q' = exp(w dt / 2) q. q4integrate uses the exact exponential
+ * map. q4stepsoa uses its Taylor polynomial of the given order, which for
+ * orders up to 4 is what the Runge-Kutta method of that order gives for
+ * constant w; it does not renormalize. The batched functions work on
+ * structure of arrays storage; use the shift functions to hand index
+ * ranges to separate threads.
+ */
+static inline v3
+v3soaget(v3soa s, size_t i)
+{
+	return v3new(s.x[i], s.y[i], s.z[i]);
+}
+
+static inline void
+v3soaset(v3soa s, size_t i, v3 v)
+{
+	s.x[i] = v.x;
+	s.y[i] = v.y;
+	s.z[i] = v.z;
+}
+
+static inline v3soa
+v3soashift(v3soa s, size_t k)
+{
+	v3soa r;
+
+	r.x = s.x + k;
+	r.y = s.y + k;
+	r.z = s.z + k;
+	return (r);
+}
+
+static inline q4
+q4soaget(q4soa s, size_t i)
+{
+	return q4new(s.w[i], s.x[i], s.y[i], s.z[i]);
+}
+
+static inline void
+q4soaset(q4soa s, size_t i, q4 q)
+{
+	s.w[i] = q.w;
+	s.x[i] = q.x;
+	s.y[i] = q.y;
+	s.z[i] = q.z;
+}
+
+static inline q4soa
+q4soashift(q4soa s, size_t k)
+{
+	q4soa r;
+
+	r.w = s.w + k;
+	r.x = s.x + k;
+	r.y = s.y + k;
+	r.z = s.z + k;
+	return (r);
+}
+
+/* Exponential of the pure quaternion (0, v). */
+static inline q4
+q4exp(v3 v)
+{
+	real t = v3len(v);
+	real s = t > (real)1.0e-4 ? (real)sin((double)t) / t : 1 - t * t / 6;
+
+	return q4new((real)cos((double)t), s * v.x, s * v.y, s * v.z);
+}
+
+static inline q4
+q4integrate(q4 q, v3 w, real dt)
+{
+	return q4q4(q4exp(v3mul(w, dt / 2)), q);
+}
+
+static inline void
+q4integratesoa(q4soa q, v3soa w, real dt, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		q4soaset(q, i, q4integrate(q4soaget(q, i), v3soaget(w, i), dt));
+}
+
+static inline void
+q4stepsoa(q4soa q, v3soa w, real dt, unsigned order, size_t n)
+{
+	real a, b, c, t2;
+	size_t i;
+	unsigned j;
+	v3 h;
+
+	for (i = 0; i < n; i++) {
+		h = v3mul(v3soaget(w, i), dt / 2);
+		t2 = v3lensq(h);
+		a = 1;
+		b = 0;
+		c = 1;
+		for (j = 1; j <= order; j++) {
+			c /= (real)j;
+			if (j & 1) {
+				b += c;
+			} else {
+				c *= -t2;
+				a += c;
+			}
+		}
+		q4soaset(q, i, q4q4(q4new(a, b * h.x, b * h.y, b * h.z),
+		    q4soaget(q, i)));
+	}
+}
+
+/* Reciprocal square root of a positive normal number: a bit-level
+ * estimate good to 4% refined by Newton steps to full precision. The
+ * estimate works on the bits of a real, so it covers the whole normal
+ * range of the precision in use. Zero, subnormals and infinity are out of
+ * range. */
+static inline real
+realrsqrt(real a)
+{
+#ifdef LINALG_SINGLE_PRECISION
+	uint32_t u, k = 0x5f3759dfu;
+#else
+	uint64_t u, k = (uint64_t)0x5fe6eb50u << 32 | 0xc7b537a9u;
+#endif
+	real y;
+
+	memcpy(&u, &a, sizeof(u));
+	u = k - (u >> 1);
+	memcpy(&y, &u, sizeof(y));
+	y = y * ((real)1.5 - (real)0.5 * a * y * y);
+	y = y * ((real)1.5 - (real)0.5 * a * y * y);
+	y = y * ((real)1.5 - (real)0.5 * a * y * y);
+#ifndef LINALG_SINGLE_PRECISION
+	y = y * ((real)1.5 - (real)0.5 * a * y * y);
+#endif
+	return (y);
+}
+
+static inline void
+q4renormsoa(q4soa q, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		q4soaset(q, i, q4mul(q4soaget(q, i),
+		    realrsqrt(q4normsq(q4soaget(q, i)))));
+}
+
+/* Pull a nearly orthogonal matrix back towards the nearest rotation with
+ * iters steps of m = m (3 - m^T m) / 2; each step squares the error. */
+static inline m33
+m33orthon(m33 m, unsigned iters)
+{
+	unsigned k;
+
+	for (k = 0; k < iters; k++)
+		m = m33mul(m33m33(m, m33sub(m33mul(m33ident(), 3),
+		    m33m33(m33trans(m), m))), (real)0.5);
+	return (m);
+}
+
+static inline void
+m33orthonn(m33 *m, size_t n, unsigned iters)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m[i] = m33orthon(m[i], iters);
+}
+
+static inline v2
+v2soaget(v2soa s, size_t i)
+{
+	return v2new(s.x[i], s.y[i]);
+}
+
+static inline void
+v2soaset(v2soa s, size_t i, v2 v)
+{
+	s.x[i] = v.x;
+	s.y[i] = v.y;
+}
+
+static inline v2soa
+v2soashift(v2soa s, size_t k)
+{
+	v2soa r;
+
+	r.x = s.x + k;
+	r.y = s.y + k;
+	return (r);
+}
+
+static inline void
+v2xform(m22 m, v2 t, const v2 *in, v2 *out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = v2add(m22v2(m, in[i]), t);
+}
+
+static inline void
+v2xformsoa(m22 m, v2 t, v2soa in, v2soa out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v2soaset(out, i, v2add(m22v2(m, v2soaget(in, i)), t));
+}
+
+/*
+ * Closed-form 2 by 2 decompositions. They take no trigonometric functions:
+ * angles are carried as (cos, sin) pairs and halved with v2halfangle.
+ */
+
+/* Unit (cos, sin) of the angle of v, or (1, 0) for the zero vector. */
+static inline v2
+v2angle(v2 v)
+{
+	real l = v2len(v);
+
+	return (l > 0 ? v2div(v, l) : v2new(1, 0));
+}
+
+/* (cos, sin) of half the angle given by the unit pair a, up to a turn by
+ * pi. */
+static inline v2
+v2halfangle(v2 a)
+{
+	real c, s;
+
+	if (a.x >= 0) {
+		c = (real)sqrt((double)((1 + a.x) / 2));
+		s = a.y / (2 * c);
+	} else {
+		s = (real)sqrt((double)((1 - a.x) / 2));
+		c = a.y / (2 * s);
+	}
+	return v2new(c, s);
+}
+
+/* Eigenvalues of the symmetric part of m in ascending order and the unit
+ * eigenvectors as columns of the rotation vec. */
+static inline void
+m22symeigen(m22 m, v2 *val, m22 *vec)
+{
+	real b = (m.xy + m.yx) / 2, e = (m.xx + m.yy) / 2;
+	v2 a = v2new((m.xx - m.yy) / 2, b);
+	real r = v2len(a);
+	v2 h = v2halfangle(v2angle(a));
+
+	*val = v2new(e - r, e + r);
+	*vec = m22rotcs(h.y, -h.x);
+}
+
+/* m = u diag(s) v^T with rotations u and v. s.x >= |s.y| and s.y is
+ * negative if m is a reflection. */
+static inline void
+m22svd(m22 m, m22 *u, v2 *s, m22 *v)
+{
+	v2 a = v2new((m.xx + m.yy) / 2, (m.yx - m.xy) / 2);
+	v2 b = v2new((m.xx - m.yy) / 2, (m.yx + m.xy) / 2);
+	real q = v2len(a), r = v2len(b);
+	v2 c = v2angle(a), d = v2angle(b);
+	v2 h = v2halfangle(v2new(c.x * d.x - c.y * d.y, c.y * d.x + c.x * d.y));
+
+	*u = m22rotcs(h.x, h.y);
+	*s = v2new(q + r, q - r);
+	*v = m22rotcs(c.x * h.x + c.y * h.y, h.y * c.x - h.x * c.y);
+}
+
+/* m = r p with a rotation r and a symmetric p. */
+static inline void
+m22polar(m22 m, m22 *r, m22 *p)
+{
+	v2 c = v2angle(v2new(m.xx + m.yy, m.yx - m.xy));
+	m22 t = m22m22(m22rotcs(c.x, -c.y), m);
+	real b = (t.xy + t.yx) / 2;
+
+	*r = m22rotcs(c.x, c.y);
+	*p = m22new(t.xx, b, b, t.yy);
+}
+
+static inline void
+m22symeigenn(const m22 *m, v2 *val, m22 *vec, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m22symeigen(m[i], &val[i], &vec[i]);
+}
+
+static inline void
+m22svdn(const m22 *m, m22 *u, v2 *s, m22 *v, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m22svd(m[i], &u[i], &s[i], &v[i]);
+}
+
+static inline void
+m22polarn(const m22 *m, m22 *r, m22 *p, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m22polar(m[i], &r[i], &p[i]);
+}
+
+/*
+ * Periodic boundaries. The columns of h are the cell vectors, so a point
+ * is h s with fractional coordinates s, and the inverse is cached. Images
+ * are found by rounding s, which gives the minimum image in orthorhombic
+ * cells. In triclinic cells rounding can miss it, so the images one cell
+ * away along each vector are searched too; this is exact for cells in
+ * reduced form, where no off-diagonal component exceeds half the
+ * corresponding diagonal one. Orthorhombic cells take a path with three
+ * multiplies instead of a matrix product. The batched functions copy the
+ * box so that writes to the output cannot alias it and test the cell kind
+ * once outside the loop. For triclinic cells they work in blocks of
+ * LINALG_SOABLOCK displacements and search each image over a whole block,
+ * so the inner loops are branch free and vectorize.
+ */
+static inline pbc3
+pbc3new(m33 h)
+{
+	pbc3 p;
+
+	p.h = h;
+	p.hinv = m33inv(h);
+	p.ortho = h.xy == 0 && h.xz == 0 && h.yx == 0 && h.yz == 0 &&
+	    h.zx == 0 && h.zy == 0;
+	return (p);
+}
+
+static inline pbc3
+pbc3ortho(v3 l)
+{
+	return pbc3new(m33new(l.x, 0, 0, 0, l.y, 0, 0, 0, l.z));
+}
+
+/* Nearest integer and floor by conversion to int, which compilers can
+ * vectorize unlike the libm calls; |a| must be below 2^31, and below 2^23
+ * in single precision. Both select between two nonzero constants, as a
+ * zero arm is turned back into a branch around the add. */
+static inline real
+realnint(real a)
+{
+	return ((real)(int)(a + (a < 0 ? (real)-0.5 : (real)0.5)));
+}
+
+static inline real
+realfloor(real a)
+{
+	real t = (real)(int)a;
+
+	return (t + (t > a ? (real)-2 : (real)-1) + 1);
+}
+
+/* Fractional coordinates of v, shifted by whole cells to the nearest
+ * integer if near is set and to the floor otherwise, back in space. The
+ * cell kind is passed in ortho so that callers can fix it. */
+static inline v3
+pbc3round(const pbc3 *p, v3 v, int near, int ortho)
+{
+	v3 s = ortho ? v3new(v.x * p->hinv.xx, v.y * p->hinv.yy,
+	    v.z * p->hinv.zz) : m33v3(p->hinv, v);
+
+	s.x -= near ? realnint(s.x) : realfloor(s.x);
+	s.y -= near ? realnint(s.y) : realfloor(s.y);
+	s.z -= near ? realnint(s.z) : realfloor(s.z);
+	return (ortho ? v3new(s.x * p->h.xx, s.y * p->h.yy, s.z * p->h.zz) :
+	    m33v3(p->h, s));
+}
+
+static inline v3
+pbc3shift(const pbc3 *p, v3 v, int near)
+{
+	return pbc3round(p, v, near, p->ortho);
+}
+
+/* Shortest of the rounded displacement d and its 26 neighbour images. */
+static inline v3
+pbc3nearest(const pbc3 *p, v3 d)
+{
+	v3 b = d, e;
+	real l = v3lensq(d), m;
+	int i, j, k;
+
+	for (i = -1; i <= 1; i++)
+		for (j = -1; j <= 1; j++)
+			for (k = -1; k <= 1; k++) {
+				e = v3add(d, m33v3(p->h,
+				    v3new((real)i, (real)j, (real)k)));
+				m = v3lensq(e);
+				b = m < l ? e : b;
+				l = m < l ? m : l;
+			}
+	return (b);
+}
+
+/* Minimum image of the displacement d. */
+static inline v3
+pbc3image(const pbc3 *p, v3 d)
+{
+	return (p->ortho ? pbc3round(p, d, 1, 1) :
+	    pbc3nearest(p, pbc3round(p, d, 1, 0)));
+}
+
+/* Position v moved into the primary cell. */
+static inline v3
+pbc3wrap(const pbc3 *p, v3 v)
+{
+	return pbc3shift(p, v, 0);
+}
+
+/* Minimum image of a - b. */
+static inline v3
+pbc3delta(const pbc3 *p, v3 a, v3 b)
+{
+	return pbc3image(p, v3sub(a, b));
+}
+
+static inline real
+pbc3distsq(const pbc3 *p, v3 a, v3 b)
+{
+	return v3lensq(pbc3delta(p, a, b));
+}
+
+static inline real
+pbc3dist(const pbc3 *p, v3 a, v3 b)
+{
+	return v3len(pbc3delta(p, a, b));
+}
+
+/* Minimum images of a block of m rounded displacements held in rows 0 to
+ * 2 of b, in place; row 3 holds their squared lengths. */
+static inline void
+pbc3nearestblk(const pbc3 *p, real (*b)[LINALG_SOABLOCK], size_t m)
+{
+	v3 o;
+	real x, y, z, l;
+	size_t i;
+	int c;
+
+	for (c = 0; c < 27; c++) {
+		if (c == 13)
+			continue;
+		o = m33v3(p->h, v3new((real)(c / 9 - 1), (real)(c / 3 % 3 - 1),
+		    (real)(c % 3 - 1)));
+		for (i = 0; i < m; i++) {
+			x = b[0][i] + o.x;
+			y = b[1][i] + o.y;
+			z = b[2][i] + o.z;
+			l = x * x + y * y + z * z;
+			b[0][i] = l < b[3][i] ? x : b[0][i];
+			b[1][i] = l < b[3][i] ? y : b[1][i];
+			b[2][i] = l < b[3][i] ? z : b[2][i];
+			b[3][i] = l < b[3][i] ? l : b[3][i];
+		}
+	}
+}
+
+/* Rounded displacements a[i] - b[i], or a - b[i] if a has stride 0, for a
+ * block of m pairs starting at j, into the rows of blk, with their
+ * triclinic minimum images. */
+static inline void
+pbc3blk(const pbc3 *p, const v3 *a, size_t sa, const v3 *b, size_t j,
+    size_t m, real (*blk)[LINALG_SOABLOCK])
+{
+	v3 e;
+	size_t i;
+
+	for (i = 0; i < m; i++) {
+		e = pbc3round(p, v3sub(a[(j + i) * sa], b[j + i]), 1, 0);
+		blk[0][i] = e.x;
+		blk[1][i] = e.y;
+		blk[2][i] = e.z;
+		blk[3][i] = v3lensq(e);
+	}
+	pbc3nearestblk(p, blk, m);
+}
+
+static inline void
+pbc3deltan(const pbc3 *p, const v3 *a, const v3 *b, v3 *d, size_t n)
+{
+	real blk[4][LINALG_SOABLOCK];
+	pbc3 q = *p;
+	size_t i, j, m;
+
+	if (q.ortho) {
+		for (i = 0; i < n; i++)
+			d[i] = pbc3round(&q, v3sub(a[i], b[i]), 1, 1);
+		return;
+	}
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		pbc3blk(&q, a, 1, b, j, m, blk);
+		for (i = 0; i < m; i++)
+			d[j + i] = v3new(blk[0][i], blk[1][i], blk[2][i]);
+	}
+}
+
+static inline void
+pbc3distsqn(const pbc3 *p, const v3 *a, const v3 *b, real *d2, size_t n)
+{
+	real blk[4][LINALG_SOABLOCK];
+	pbc3 q = *p;
+	size_t i, j, m;
+
+	if (q.ortho) {
+		for (i = 0; i < n; i++)
+			d2[i] = v3lensq(pbc3round(&q, v3sub(a[i], b[i]), 1, 1));
+		return;
+	}
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		pbc3blk(&q, a, 1, b, j, m, blk);
+		memcpy(d2 + j, blk[3], m * sizeof(real));
+	}
+}
+
+/* Squared distances from a to each point of b. */
+static inline void
+pbc3distsqto(const pbc3 *p, v3 a, const v3 *b, real *d2, size_t n)
+{
+	real blk[4][LINALG_SOABLOCK];
+	pbc3 q = *p;
+	size_t i, j, m;
+
+	if (q.ortho) {
+		for (i = 0; i < n; i++)
+			d2[i] = v3lensq(pbc3round(&q, v3sub(a, b[i]), 1, 1));
+		return;
+	}
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		pbc3blk(&q, &a, 0, b, j, m, blk);
+		memcpy(d2 + j, blk[3], m * sizeof(real));
+	}
+}
+
+static inline void
+pbc3wrapn(const pbc3 *p, v3 *v, size_t n)
+{
+	pbc3 q = *p;
+	size_t i;
+
+	if (q.ortho)
+		for (i = 0; i < n; i++)
+			v[i] = pbc3round(&q, v[i], 0, 1);
+	else
+		for (i = 0; i < n; i++)
+			v[i] = pbc3round(&q, v[i], 0, 0);
+}
+
+/*
+ * Counter-based random numbers. Draw i of a stream is the Philox4x32-10
+ * block cipher applied to the counter (i, stream) under the key seed, so
+ * draws need no state, can be generated in any order or split across any
+ * number of threads, and still come out the same. Each random vector or
+ * quaternion uses one block of four 32-bit words; uniforms therefore have
+ * 32 bits of resolution in double precision and 24 in single.
+ */
+#define LINALG_2PI 6.28318530717958647692
+
+static inline rng
+rngnew(uint64_t seed, uint64_t id)
+{
+	rng r;
+
+	r.seed = seed;
+	r.stream = id;
+	return (r);
+}
+
+static inline void
+philox4x32(uint32_t c[4], const uint32_t key[2])
+{
+	uint32_t k0 = key[0], k1 = key[1];
+	uint64_t p0, p1;
+	unsigned r;
+
+	for (r = 0; r < 10; r++) {
+		if (r > 0) {
+			k0 += 0x9e3779b9u;
+			k1 += 0xbb67ae85u;
+		}
+		p0 = (uint64_t)0xd2511f53u * c[0];
+		p1 = (uint64_t)0xcd9e8d57u * c[2];
+		c[0] = (uint32_t)(p1 >> 32) ^ c[1] ^ k0;
+		c[1] = (uint32_t)p1;
+		c[2] = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+		c[3] = (uint32_t)p0;
+	}
+}
+
+static inline void
+rngblock(rng g, uint64_t i, uint32_t out[4])
+{
+	uint32_t key[2];
+
+	key[0] = (uint32_t)g.seed;
+	key[1] = (uint32_t)(g.seed >> 32);
+	out[0] = (uint32_t)i;
+	out[1] = (uint32_t)(i >> 32);
+	out[2] = (uint32_t)g.stream;
+	out[3] = (uint32_t)(g.stream >> 32);
+	philox4x32(out, key);
+}
+
+/* Uniform in [0, 1). */
+static inline real
+rnguniform(uint32_t u)
+{
+#ifdef LINALG_SINGLE_PRECISION
+	return ((real)(u >> 8) * (real)(1.0 / 16777216.0));
+#else
+	return ((real)u * (real)(1.0 / 4294967296.0));
+#endif
+}
+
+/* Uniform unit vector from two words. */
+static inline v3
+v3randunit(const uint32_t u[2])
+{
+	real z = 2 * rnguniform(u[0]) - 1;
+	real a = (real)LINALG_2PI * rnguniform(u[1]);
+	real r = (real)sqrt((double)(1 - z * z));
+
+	return v3new(r * (real)cos((double)a), r * (real)sin((double)a), z);
+}
+
+/* Uniform rotation by Shoemake's method from three words. */
+static inline q4
+q4randunit(const uint32_t u[3])
+{
+	real s = rnguniform(u[0]);
+	real r1 = (real)sqrt((double)(1 - s)), r2 = (real)sqrt((double)s);
+	real a1 = (real)LINALG_2PI * rnguniform(u[1]);
+	real a2 = (real)LINALG_2PI * rnguniform(u[2]);
+
+	return q4new(r2 * (real)cos((double)a2), r1 * (real)sin((double)a1),
+	    r1 * (real)cos((double)a1), r2 * (real)sin((double)a2));
+}
+
+/* Rotation about a uniform axis by an angle uniform in [-mag, mag], from
+ * three words. */
+static inline q4
+q4randsmall(const uint32_t u[3], real mag)
+{
+	v3 a = v3randunit(u);
+	real h = mag * (rnguniform(u[2]) - (real)0.5);
+	real s = (real)sin((double)h);
+
+	return q4new((real)cos((double)h), s * a.x, s * a.y, s * a.z);
+}
+
+/* Uniforms numbered i0 to i0 + n - 1, four to a block. */
+static inline void
+rnguniformn(rng g, uint64_t i0, real *out, size_t n)
+{
+	uint32_t b[4];
+	uint64_t i;
+	size_t j;
+
+	for (j = 0; j < n; j++) {
+		i = i0 + j;
+		if (j == 0 || i % 4 == 0)
+			rngblock(g, i / 4, b);
+		out[j] = rnguniform(b[i % 4]);
+	}
+}
+
+static inline void
+v3randunitn(rng g, uint64_t i0, v3 *out, size_t n)
+{
+	uint32_t b[4];
+	size_t j;
+
+	for (j = 0; j < n; j++) {
+		rngblock(g, i0 + j, b);
+		out[j] = v3randunit(b);
+	}
+}
+
+static inline void
+q4randunitn(rng g, uint64_t i0, q4 *out, size_t n)
+{
+	uint32_t b[4];
+	size_t j;
+
+	for (j = 0; j < n; j++) {
+		rngblock(g, i0 + j, b);
+		out[j] = q4randunit(b);
+	}
+}
+
+static inline void
+q4randsmalln(rng g, uint64_t i0, real mag, q4 *out, size_t n)
+{
+	uint32_t b[4];
+	size_t j;
+
+	for (j = 0; j < n; j++) {
+		rngblock(g, i0 + j, b);
+		out[j] = q4randsmall(b, mag);
+	}
+}
+
+/*
+ * Forward-mode differentiation with dual numbers. A dual carries a value
+ * and LINALG_DUALN tangents, 3 by default so that the gradient with
+ * respect to one v3 comes out of a single pass. Seed inputs with dualvar,
+ * v3dvar or q4dvar, evaluate with the dual operations and read the
+ * derivatives from the tangents. dualapply adds any other function given
+ * its value and derivative at the input. Lanes from LINALG_DUALN on are
+ * not stored: seeding them has no effect and they read as zero.
+ */
+static inline dual
+dualnew(real v)
+{
+	dual r;
+	unsigned k;
+
+	r.v = v;
+	for (k = 0; k < LINALG_DUALN; k++)
+		r.d[k] = 0;
+	return (r);
+}
+
+/* Independent variable with unit tangent in the given lane. */
+static inline dual
+dualvar(real v, unsigned lane)
+{
+	dual r = dualnew(v);
+
+	if (lane < LINALG_DUALN)
+		r.d[lane] = 1;
+	return (r);
+}
+
+/* f(a) given f and f' at a.v. */
+static inline dual
+dualapply(dual a, real f, real df)
+{
+	dual r;
+	unsigned k;
+
+	r.v = f;
+	for (k = 0; k < LINALG_DUALN; k++)
+		r.d[k] = df * a.d[k];
+	return (r);
+}
+
+static inline dual
+dualadd(dual a, dual b)
+{
+	dual r;
+	unsigned k;
+
+	r.v = a.v + b.v;
+	for (k = 0; k < LINALG_DUALN; k++)
+		r.d[k] = a.d[k] + b.d[k];
+	return (r);
+}
+
+static inline dual
+dualsub(dual a, dual b)
+{
+	dual r;
+	unsigned k;
+
+	r.v = a.v - b.v;
+	for (k = 0; k < LINALG_DUALN; k++)
+		r.d[k] = a.d[k] - b.d[k];
+	return (r);
+}
+
+static inline dual
+dualneg(dual a)
+{
+	return dualapply(a, -a.v, -1);
+}
+
+static inline dual
+dualscale(dual a, real s)
+{
+	return dualapply(a, a.v * s, s);
+}
+
+static inline dual
+dualmul(dual a, dual b)
+{
+	dual r;
+	unsigned k;
+
+	r.v = a.v * b.v;
+	for (k = 0; k < LINALG_DUALN; k++)
+		r.d[k] = a.d[k] * b.v + a.v * b.d[k];
+	return (r);
+}
+
+static inline dual
+dualdiv(dual a, dual b)
+{
+	dual r;
+	unsigned k;
+
+	r.v = a.v / b.v;
+	for (k = 0; k < LINALG_DUALN; k++)
+		r.d[k] = (a.d[k] - r.v * b.d[k]) / b.v;
+	return (r);
+}
+
+static inline dual
+dualsqrt(dual a)
+{
+	real s = (real)sqrt((double)a.v);
+
+	return dualapply(a, s, 1 / (2 * s));
+}
+
+static inline dual
+dualsin(dual a)
+{
+	return dualapply(a, (real)sin((double)a.v), (real)cos((double)a.v));
+}
+
+static inline dual
+dualcos(dual a)
+{
+	return dualapply(a, (real)cos((double)a.v), -(real)sin((double)a.v));
+}
+
+/* The tangent in the given lane. */
+static inline real
+dualtan(dual a, unsigned lane)
+{
+	return (lane < LINALG_DUALN ? a.d[lane] : 0);
+}
+
+/* The tangents in lanes lane to lane + 2 as a vector. */
+static inline v3
+dualgrad(dual a, unsigned lane)
+{
+	return v3new(dualtan(a, lane), dualtan(a, lane + 1),
+	    dualtan(a, lane + 2));
+}
+
+static inline v3d
+v3dnew(dual x, dual y, dual z)
+{
+	v3d v;
+
+	v.x = x;
+	v.y = y;
+	v.z = z;
+	return (v);
+}
+
+static inline v3d
+v3dconst(v3 v)
+{
+	return v3dnew(dualnew(v.x), dualnew(v.y), dualnew(v.z));
+}
+
+/* Independent vector with its components in lanes lane to lane + 2. */
+static inline v3d
+v3dvar(v3 v, unsigned lane)
+{
+	return v3dnew(dualvar(v.x, lane), dualvar(v.y, lane + 1),
+	    dualvar(v.z, lane + 2));
+}
+
+static inline v3
+v3dval(v3d v)
+{
+	return v3new(v.x.v, v.y.v, v.z.v);
+}
+
+/* Jacobian of v with respect to the variables in lanes lane to
+ * lane + 2; row i is the gradient of component i. */
+static inline m33
+v3djac(v3d v, unsigned lane)
+{
+	v3 x = dualgrad(v.x, lane), y = dualgrad(v.y, lane);
+	v3 z = dualgrad(v.z, lane);
+
+	return m33new(x.x, x.y, x.z, y.x, y.y, y.z, z.x, z.y, z.z);
+}
+
+static inline v3d
+v3dadd(v3d a, v3d b)
+{
+	return v3dnew(dualadd(a.x, b.x), dualadd(a.y, b.y),
+	    dualadd(a.z, b.z));
+}
+
+static inline v3d
+v3dsub(v3d a, v3d b)
+{
+	return v3dnew(dualsub(a.x, b.x), dualsub(a.y, b.y),
+	    dualsub(a.z, b.z));
+}
+
+static inline v3d
+v3dneg(v3d v)
+{
+	return v3dnew(dualneg(v.x), dualneg(v.y), dualneg(v.z));
+}
+
+static inline v3d
+v3dmul(v3d v, dual s)
+{
+	return v3dnew(dualmul(v.x, s), dualmul(v.y, s), dualmul(v.z, s));
+}
+
+static inline v3d
+v3dscale(v3d v, real s)
+{
+	return v3dnew(dualscale(v.x, s), dualscale(v.y, s),
+	    dualscale(v.z, s));
+}
+
+static inline dual
+v3ddot(v3d a, v3d b)
+{
+	return dualadd(dualadd(dualmul(a.x, b.x), dualmul(a.y, b.y)),
+	    dualmul(a.z, b.z));
+}
+
+static inline v3d
+v3dcross(v3d a, v3d b)
+{
+	return v3dnew(dualsub(dualmul(a.y, b.z), dualmul(a.z, b.y)),
+		      dualsub(dualmul(a.z, b.x), dualmul(a.x, b.z)),
+		      dualsub(dualmul(a.x, b.y), dualmul(a.y, b.x)));
+}
+
+static inline dual
+v3dlensq(v3d v)
+{
+	return v3ddot(v, v);
+}
+
+static inline dual
+v3dlen(v3d v)
+{
+	return dualsqrt(v3dlensq(v));
+}
+
+static inline v3d
+v3dunit(v3d v)
+{
+	dual l = v3dlen(v);
+
+	return v3dnew(dualdiv(v.x, l), dualdiv(v.y, l), dualdiv(v.z, l));
+}
+
+/* Product of a constant matrix and a dual vector. */
+static inline v3d
+m33v3d(m33 m, v3d v)
+{
+	return v3dnew(
+	    dualadd(dualadd(dualscale(v.x, m.xx), dualscale(v.y, m.xy)),
+		dualscale(v.z, m.xz)),
+	    dualadd(dualadd(dualscale(v.x, m.yx), dualscale(v.y, m.yy)),
+		dualscale(v.z, m.yz)),
+	    dualadd(dualadd(dualscale(v.x, m.zx), dualscale(v.y, m.zy)),
+		dualscale(v.z, m.zz)));
+}
+
+/* Rotation of a dual vector by a constant quaternion. */
+static inline v3d
+q4v3d(q4 q, v3d v)
+{
+	return m33v3d(q4m33(q), v);
+}
+
+static inline m33d
+m33dnew(dual xx, dual xy, dual xz,
+        dual yx, dual yy, dual yz,
+        dual zx, dual zy, dual zz)
+{
+	m33d m = { xx, xy, xz, yx, yy, yz, zx, zy, zz };
+	return (m);
+}
+
+static inline m33d
+m33dconst(m33 m)
+{
+	return m33dnew(dualnew(m.xx), dualnew(m.xy), dualnew(m.xz),
+		       dualnew(m.yx), dualnew(m.yy), dualnew(m.yz),
+		       dualnew(m.zx), dualnew(m.zy), dualnew(m.zz));
+}
+
+static inline m33
+m33dval(m33d m)
+{
+	return m33new(m.xx.v, m.xy.v, m.xz.v,
+		      m.yx.v, m.yy.v, m.yz.v,
+		      m.zx.v, m.zy.v, m.zz.v);
+}
+
+static inline m33d
+m33dtrans(m33d m)
+{
+	return m33dnew(m.xx, m.yx, m.zx, m.xy, m.yy, m.zy, m.xz, m.yz, m.zz);
+}
+
+static inline v3d
+m33dv3d(m33d m, v3d v)
+{
+	return v3dnew(v3ddot(v3dnew(m.xx, m.xy, m.xz), v),
+		      v3ddot(v3dnew(m.yx, m.yy, m.yz), v),
+		      v3ddot(v3dnew(m.zx, m.zy, m.zz), v));
+}
+
+static inline m33d
+m33dm33d(m33d a, m33d b)
+{
+	v3d x = v3dnew(a.xx, a.xy, a.xz), y = v3dnew(a.yx, a.yy, a.yz);
+	v3d z = v3dnew(a.zx, a.zy, a.zz), u = v3dnew(b.xx, b.yx, b.zx);
+	v3d v = v3dnew(b.xy, b.yy, b.zy), w = v3dnew(b.xz, b.yz, b.zz);
+
+	return m33dnew(v3ddot(x, u), v3ddot(x, v), v3ddot(x, w),
+		       v3ddot(y, u), v3ddot(y, v), v3ddot(y, w),
+		       v3ddot(z, u), v3ddot(z, v), v3ddot(z, w));
+}
+
+static inline dual
+m33ddet(m33d m)
+{
+	return v3ddot(v3dnew(m.xx, m.xy, m.xz),
+	    v3dcross(v3dnew(m.yx, m.yy, m.yz), v3dnew(m.zx, m.zy, m.zz)));
+}
+
+static inline q4d
+q4dnew(dual w, dual x, dual y, dual z)
+{
+	q4d q;
+
+	q.w = w;
+	q.x = x;
+	q.y = y;
+	q.z = z;
+	return (q);
+}
+
+static inline q4d
+q4dconst(q4 q)
+{
+	return q4dnew(dualnew(q.w), dualnew(q.x), dualnew(q.y), dualnew(q.z));
+}
+
+/* Independent quaternion with w, x, y and z in lanes lane to lane + 3. */
+static inline q4d
+q4dvar(q4 q, unsigned lane)
+{
+	return q4dnew(dualvar(q.w, lane), dualvar(q.x, lane + 1),
+	    dualvar(q.y, lane + 2), dualvar(q.z, lane + 3));
+}
+
+static inline q4
+q4dval(q4d q)
+{
+	return q4new(q.w.v, q.x.v, q.y.v, q.z.v);
+}
+
+static inline q4d
+q4dconj(q4d q)
+{
+	return q4dnew(q.w, dualneg(q.x), dualneg(q.y), dualneg(q.z));
+}
+
+static inline q4d
+q4dq4d(q4d a, q4d b)
+{
+	v3d u = v3dnew(a.x, a.y, a.z), v = v3dnew(b.x, b.y, b.z);
+	v3d r = v3dadd(v3dadd(v3dmul(v, a.w), v3dmul(u, b.w)),
+	    v3dcross(u, v));
+
+	return q4dnew(dualsub(dualmul(a.w, b.w), v3ddot(u, v)), r.x, r.y, r.z);
+}
+
+static inline dual
+q4dnormsq(q4d q)
+{
+	return dualadd(dualmul(q.w, q.w), v3dlensq(v3dnew(q.x, q.y, q.z)));
+}
+
+static inline q4d
+q4dunit(q4d q)
+{
+	dual l = dualsqrt(q4dnormsq(q));
+
+	return q4dnew(dualdiv(q.w, l), dualdiv(q.x, l), dualdiv(q.y, l),
+	    dualdiv(q.z, l));
+}
+
+/* Rotation of a dual vector by a dual unit quaternion. */
+static inline v3d
+q4dv3d(q4d q, v3d v)
+{
+	v3d u = v3dnew(q.x, q.y, q.z);
+	v3d t = v3dscale(v3dcross(u, v), 2);
+
+	return v3dadd(v3dadd(v, v3dmul(t, q.w)), v3dcross(u, t));
+}
+
+/*
+ * Pair distance histograms with nbin equal bins in r up to the cutoff
+ * rmax. Pairs are binned by squared distance: a table over r^2 with
+ * LINALG_HISTLOOK cells per bin gives a starting bin that is corrected
+ * against the squared edges, so no square root is taken. The hist3 holds
+ * only this read-only geometry and can be shared by threads; counts go
+ * into arrays of nbin entries owned by the caller, one per thread, that
+ * are merged with hist3merge. Counts are only added to, so frames
+ * accumulate until the caller clears them. The pair functions take a
+ * range of rows [i0, i1) to split between threads and an optional
+ * periodic cell. With a cell each pair is counted once at its minimum
+ * image distance, so the counts are complete only for rmax up to half the
+ * smallest perpendicular width of the cell; farther images are not
+ * counted. hist3init needs nbin + 1 entries in edge2 and
+ * LINALG_HISTLOOK * nbin + 1 in look.
+ */
+static inline void
+hist3init(hist3 *h, real rmax, size_t nbin, real *edge2, uint32_t *look)
+{
+	size_t k, b = 0;
+	real r2;
+
+	h->nbin = nbin;
+	h->nlook = LINALG_HISTLOOK * nbin;
+	h->rmax = rmax;
+	h->rmax2 = rmax * rmax;
+	h->scale = (real)h->nlook / h->rmax2;
+	h->edge2 = edge2;
+	h->look = look;
+	for (k = 0; k < nbin; k++)
+		edge2[k] = (rmax * (real)k / (real)nbin) *
+		    (rmax * (real)k / (real)nbin);
+	edge2[nbin] = h->rmax2;
+	for (k = 0; k <= h->nlook; k++) {
+		r2 = (real)k / h->scale;
+		while (b + 1 < nbin && edge2[b + 1] <= r2)
+			b++;
+		look[k] = (uint32_t)b;
+	}
+}
+
+/* Bin of the squared distance d2, or nbin beyond the cutoff. */
+static inline size_t
+hist3bin(const hist3 *h, real d2)
+{
+	size_t b;
+
+	if (!(d2 < h->rmax2))
+		return (h->nbin);
+	b = h->look[(size_t)(d2 * h->scale)];
+	while (b > 0 && d2 < h->edge2[b])
+		b--;
+	while (d2 >= h->edge2[b + 1])
+		b++;
+	return (b);
+}
+
+static inline void
+hist3clear(uint64_t *count, size_t nbin)
+{
+	memset(count, 0, nbin * sizeof(*count));
+}
+
+static inline void
+hist3merge(uint64_t *dst, const uint64_t *src, size_t nbin)
+{
+	size_t k;
+
+	for (k = 0; k < nbin; k++)
+		dst[k] += src[k];
+}
+
+static inline void
+hist3add(const hist3 *h, real d2, uint64_t *count)
+{
+	size_t b = hist3bin(h, d2);
+
+	if (b < h->nbin)
+		count[b]++;
+}
+
+/* Distances from a to the n points of b in the cell p, binned in blocks
+ * so that the batched distances vectorize. */
+static inline void
+hist3row(const hist3 *h, const pbc3 *p, v3 a, const v3 *b, size_t n,
+    uint64_t *count)
+{
+	real d2[LINALG_SOABLOCK];
+	size_t j, k, m;
+
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		pbc3distsqto(p, a, b + j, d2, m);
+		for (k = 0; k < m; k++)
+			hist3add(h, d2[k], count);
+	}
+}
+
+/* Pairs i < j of one set for rows i in [i0, i1). */
+static inline void
+hist3self(const hist3 *h, const pbc3 *p, const v3 *a, size_t n, size_t i0,
+    size_t i1, uint64_t *count)
+{
+	hist3 g = *h;
+	size_t i, j;
+
+	if (p) {
+		for (i = i0; i < i1; i++)
+			hist3row(&g, p, a[i], a + i + 1, n - i - 1, count);
+	} else {
+		for (i = i0; i < i1; i++)
+			for (j = i + 1; j < n; j++)
+				hist3add(&g, v3distsq(a[i], a[j]), count);
+	}
+}
+
+/* Pairs of a[i] for i in [i0, i1) with every point of b. */
+static inline void
+hist3cross(const hist3 *h, const pbc3 *p, const v3 *a, size_t i0, size_t i1,
+    const v3 *b, size_t nb, uint64_t *count)
+{
+	hist3 g = *h;
+	size_t i, j;
+
+	if (p) {
+		for (i = i0; i < i1; i++)
+			hist3row(&g, p, a[i], b, nb, count);
+	} else {
+		for (i = i0; i < i1; i++)
+			for (j = 0; j < nb; j++)
+				hist3add(&g, v3distsq(a[i], b[j]), count);
+	}
+}
+
+/* Radial distribution g(r) from counts over nframe frames with npair
+ * pairs each in a volume vol. */
+static inline void
+hist3rdf(const hist3 *h, const uint64_t *count, size_t nframe, double npair,
+    double vol, real *rdf)
+{
+	double r0, r1, shell;
+	size_t k;
+
+	for (k = 0; k < h->nbin; k++) {
+		r0 = (double)h->rmax * (double)k / (double)h->nbin;
+		r1 = (double)h->rmax * (double)(k + 1) / (double)h->nbin;
+		shell = 2.0 / 3.0 * LINALG_2PI *
+		    (r1 * r1 * r1 - r0 * r0 * r0);
+		rdf[k] = (real)((double)count[k] * vol /
+		    ((double)nframe * npair * shell));
+	}
+}
+
+/*
+ * Closest points on segments, triangles and planes. Degenerate segments
+ * and triangles are handled without special cases: reciprocals of a zero
+ * length or area are taken as zero with realinvpos and the result falls
+ * back to an endpoint or an edge. Triangles too thin for reliable
+ * barycentric coordinates also use the nearest edge. The routines select
+ * rather than branch on regions and never divide by zero. The structure
+ * of arrays versions work in blocks of LINALG_SOABLOCK pairs like the
+ * batched inverses: divisors are guarded in one loop and divided in the
+ * next, and every select reads values an earlier loop stored, so no
+ * arithmetic depends on a condition and compilers vectorize each loop.
+ */
+/* 1 / a for positive a and 0 otherwise, without a division by zero. */
+static inline real
+realinvpos(real a)
+{
+	real r = 1 / (a > 0 ? a : 1);
+
+	return (a > 0 ? r : 0);
+}
+
+static inline seg3
+seg3new(v3 a, v3 b)
+{
+	seg3 s;
+
+	s.a = a;
+	s.b = b;
+	return (s);
+}
+
+/* Point at parameter t, from a at 0 to b at 1. */
+static inline v3
+seg3at(seg3 s, real t)
+{
+	return v3add(s.a, v3mul(v3sub(s.b, s.a), t));
+}
+
+static inline v3
+seg3closest(seg3 s, v3 p)
+{
+	v3 d = v3sub(s.b, s.a);
+	real t = v3dot(v3sub(p, s.a), d) * realinvpos(v3dot(d, d));
+
+	return seg3at(s, realclamp(t, 0, 1));
+}
+
+/* Parameters of the closest points of two segments, s on a and t on b. */
+static inline v2
+seg3seg3param(seg3 a, seg3 b)
+{
+	v3 d1 = v3sub(a.b, a.a), d2 = v3sub(b.b, b.a), r = v3sub(a.a, b.a);
+	real aa = v3dot(d1, d1), e = v3dot(d2, d2), f = v3dot(d2, r);
+	real c = v3dot(d1, r), bb = v3dot(d1, d2);
+	real den = aa * e - bb * bb;
+	real ia = realinvpos(aa), ie = realinvpos(e);
+	real u0 = realclamp((bb * f - c * e) * realinvpos(den), 0, 1);
+	real u1 = realclamp(-c * ia, 0, 1), u2 = realclamp((bb - c) * ia, 0, 1);
+	real u = den > 0 ? u0 : u1;
+	real v = (bb * u + f) * ie;
+
+	u = v < 0 ? u1 : u;
+	u = v > 1 ? u2 : u;
+	return v2new(u, realclamp(v, 0, 1));
+}
+
+/* Squared distance between two segments; s and t may be NULL. */
+static inline real
+seg3seg3(seg3 a, seg3 b, real *s, real *t)
+{
+	v2 p = seg3seg3param(a, b);
+
+	if (s)
+		*s = p.x;
+	if (t)
+		*t = p.y;
+	return v3distsq(seg3at(a, p.x), seg3at(b, p.y));
+}
+
+static inline tri3
+tri3new(v3 a, v3 b, v3 c)
+{
+	tri3 t;
+
+	t.a = a;
+	t.b = b;
+	t.c = c;
+	return (t);
+}
+
+/* Closest point to p on the triangle with corner a and edges e1, e2. */
+static inline v3
+tri3closestedges(v3 a, v3 e1, v3 e2, v3 p)
+{
+	v3 v = v3sub(p, a);
+	real d00 = v3dot(e1, e1), d01 = v3dot(e1, e2), d11 = v3dot(e2, e2);
+	real d20 = v3dot(v, e1), d21 = v3dot(v, e2);
+	real den = d00 * d11 - d01 * d01;
+	real id = realinvpos(den);
+	real u = (d11 * d20 - d01 * d21) * id;
+	real w = (d00 * d21 - d01 * d20) * id;
+	v3 b = v3add(a, e1), c = v3add(a, e2);
+	v3 p0 = seg3closest(seg3new(a, b), p);
+	v3 p1 = seg3closest(seg3new(b, c), p);
+	v3 p2 = seg3closest(seg3new(c, a), p);
+	real q0 = v3distsq(p0, p), q1 = v3distsq(p1, p), q2 = v3distsq(p2, p);
+	v3 e = q1 < q0 ? p1 : p0;
+	int in = (den > 64 * (real)LINALG_EPSILON * d00 * d11) &
+	    (u >= 0) & (w >= 0) & (u + w <= 1);
+
+	e = q2 < (q1 < q0 ? q1 : q0) ? p2 : e;
+	return (in ? v3add(a, v3add(v3mul(e1, u), v3mul(e2, w))) : e);
+}
+
+static inline v3
+tri3closest(tri3 t, v3 p)
+{
+	return tri3closestedges(t.a, v3sub(t.b, t.a), v3sub(t.c, t.a), p);
+}
+
+/* Plane with normal n through the point p; n need not be unit. */
+static inline plane3
+plane3new(v3 n, v3 p)
+{
+	plane3 pl;
+
+	pl.n = v3unit(n);
+	pl.d = v3dot(pl.n, p);
+	return (pl);
+}
+
+static inline plane3
+plane3tri(tri3 t)
+{
+	return plane3new(v3cross(v3sub(t.b, t.a), v3sub(t.c, t.a)), t.a);
+}
+
+/* Signed distance, positive on the side the normal points to. */
+static inline real
+plane3dist(plane3 pl, v3 p)
+{
+	return (v3dot(pl.n, p) - pl.d);
+}
+
+static inline v3
+plane3closest(plane3 pl, v3 p)
+{
+	return v3sub(p, v3mul(pl.n, plane3dist(pl, p)));
+}
+
+static inline seg3
+seg3soaget(seg3soa s, size_t i)
+{
+	return seg3new(v3soaget(s.a, i), v3soaget(s.b, i));
+}
+
+/* Closest points c and squared distances d2 of the points p to the
+ * segments s, pair by pair. */
+static inline void
+seg3closestsoa(seg3soa s, v3soa p, v3soa c, real *d2, size_t n)
+{
+	real b[4][LINALG_SOABLOCK], l;
+	size_t i, j, m;
+	v3 a, d, q;
+
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		for (i = 0; i < m; i++) {
+			a = v3soaget(s.a, j + i);
+			d = v3sub(v3soaget(s.b, j + i), a);
+			l = v3dot(d, d);
+			b[0][i] = v3dot(v3sub(v3soaget(p, j + i), a), d);
+			b[1][i] = l > 0 ? l : 1;
+		}
+		for (i = 0; i < m; i++)
+			b[0][i] = realclamp(b[0][i] * (1 / b[1][i]), 0, 1);
+		for (i = 0; i < m; i++) {
+			a = v3soaget(s.a, j + i);
+			d = v3sub(v3soaget(s.b, j + i), a);
+			q = v3soaget(p, j + i);
+			a = v3add(a, v3mul(d, b[0][i]));
+			b[0][i] = a.x;
+			b[1][i] = a.y;
+			b[2][i] = a.z;
+			b[3][i] = v3distsq(q, a);
+		}
+		memcpy(c.x + j, b[0], m * sizeof(real));
+		memcpy(c.y + j, b[1], m * sizeof(real));
+		memcpy(c.z + j, b[2], m * sizeof(real));
+		memcpy(d2 + j, b[3], m * sizeof(real));
+	}
+}
+
+static inline void
+seg3seg3soa(seg3soa a, seg3soa b, real *s, real *t, real *d2, size_t n)
+{
+	real k[8][LINALG_SOABLOCK], aa, e, f, c, bb, den, ia, u, v, u1, u2;
+	size_t i, j, m;
+	v3 da, db, r;
+
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		for (i = 0; i < m; i++) {
+			da = v3sub(v3soaget(a.b, j + i), v3soaget(a.a, j + i));
+			db = v3sub(v3soaget(b.b, j + i), v3soaget(b.a, j + i));
+			r = v3sub(v3soaget(a.a, j + i), v3soaget(b.a, j + i));
+			aa = v3dot(da, da);
+			e = v3dot(db, db);
+			f = v3dot(db, r);
+			c = v3dot(da, r);
+			bb = v3dot(da, db);
+			den = aa * e - bb * bb;
+			k[0][i] = aa > 0 ? aa : 1;
+			k[1][i] = e > 0 ? e : 1;
+			k[2][i] = den > 0 ? den : 1;
+			k[3][i] = c;
+			k[4][i] = bb;
+			k[5][i] = f;
+			k[6][i] = e;
+			k[7][i] = den;
+		}
+		for (i = 0; i < m; i++) {
+			ia = 1 / k[0][i];
+			c = k[3][i];
+			bb = k[4][i];
+			k[1][i] = 1 / k[1][i];
+			k[2][i] = realclamp((bb * k[5][i] - c * k[6][i]) *
+			    (1 / k[2][i]), 0, 1);
+			k[0][i] = realclamp(-c * ia, 0, 1);
+			k[3][i] = realclamp((bb - c) * ia, 0, 1);
+		}
+		for (i = 0; i < m; i++) {
+			u = k[2][i];
+			u1 = k[0][i];
+			u2 = k[3][i];
+			u = k[7][i] > 0 ? u : u1;
+			v = (k[4][i] * u + k[5][i]) * k[1][i];
+			u = v < 0 ? u1 : u;
+			u = v > 1 ? u2 : u;
+			v = realclamp(v, 0, 1);
+			k[0][i] = u;
+			k[1][i] = v;
+			k[2][i] = v3distsq(seg3at(seg3soaget(a, j + i), u),
+			    seg3at(seg3soaget(b, j + i), v));
+		}
+		memcpy(s + j, k[0], m * sizeof(real));
+		memcpy(t + j, k[1], m * sizeof(real));
+		memcpy(d2 + j, k[2], m * sizeof(real));
+	}
+}
+
+static inline void
+tri3closestsoa(tri3soa t, v3soa p, v3soa c, real *d2, size_t n)
+{
+	real k[10][LINALG_SOABLOCK], d00, d01, d11, d20, d21, den;
+	real u, w, l0, l1, l2, q0, q1, q2, in;
+	size_t i, j, m;
+	v3 a, e1, e2, q, v, tb, tc, p0, p1, p2, e;
+
+	for (j = 0; j < n; j += m) {
+		m = n - j < LINALG_SOABLOCK ? n - j : LINALG_SOABLOCK;
+		for (i = 0; i < m; i++) {
+			a = v3new(t.ax[j + i], t.ay[j + i], t.az[j + i]);
+			e1 = v3new(t.e1x[j + i], t.e1y[j + i], t.e1z[j + i]);
+			e2 = v3new(t.e2x[j + i], t.e2y[j + i], t.e2z[j + i]);
+			q = v3soaget(p, j + i);
+			v = v3sub(q, a);
+			d00 = v3dot(e1, e1);
+			d01 = v3dot(e1, e2);
+			d11 = v3dot(e2, e2);
+			d20 = v3dot(v, e1);
+			d21 = v3dot(v, e2);
+			den = d00 * d11 - d01 * d01;
+			tb = v3add(a, e1);
+			tc = v3add(a, e2);
+			l0 = v3dot(v3sub(tb, a), v3sub(tb, a));
+			l1 = v3dot(v3sub(tc, tb), v3sub(tc, tb));
+			l2 = v3dot(v3sub(a, tc), v3sub(a, tc));
+			k[0][i] = den > 0 ? den : 1;
+			k[1][i] = l0 > 0 ? l0 : 1;
+			k[2][i] = l1 > 0 ? l1 : 1;
+			k[3][i] = l2 > 0 ? l2 : 1;
+			k[4][i] = v3dot(v3sub(q, a), v3sub(tb, a));
+			k[5][i] = v3dot(v3sub(q, tb), v3sub(tc, tb));
+			k[6][i] = v3dot(v3sub(q, tc), v3sub(a, tc));
+			k[7][i] = den > 64 * (real)LINALG_EPSILON * d00 * d11;
+			k[8][i] = d11 * d20 - d01 * d21;
+			k[9][i] = d00 * d21 - d01 * d20;
+		}
+		for (i = 0; i < m; i++) {
+			u = k[8][i] * (1 / k[0][i]);
+			w = k[9][i] * (1 / k[0][i]);
+			in = k[7][i];
+			in = u >= 0 ? in : 0;
+			in = w >= 0 ? in : 0;
+			in = u + w <= 1 ? in : 0;
+			l0 = realclamp(k[4][i] * (1 / k[1][i]), 0, 1);
+			l1 = realclamp(k[5][i] * (1 / k[2][i]), 0, 1);
+			l2 = realclamp(k[6][i] * (1 / k[3][i]), 0, 1);
+			k[0][i] = u;
+			k[1][i] = w;
+			k[2][i] = in;
+			k[3][i] = l0;
+			k[4][i] = l1;
+			k[5][i] = l2;
+		}
+		for (i = 0; i < m; i++) {
+			a = v3new(t.ax[j + i], t.ay[j + i], t.az[j + i]);
+			e1 = v3new(t.e1x[j + i], t.e1y[j + i], t.e1z[j + i]);
+			e2 = v3new(t.e2x[j + i], t.e2y[j + i], t.e2z[j + i]);
+			q = v3soaget(p, j + i);
+			tb = v3add(a, e1);
+			tc = v3add(a, e2);
+			p0 = v3add(a, v3mul(v3sub(tb, a), k[3][i]));
+			p1 = v3add(tb, v3mul(v3sub(tc, tb), k[4][i]));
+			p2 = v3add(tc, v3mul(v3sub(a, tc), k[5][i]));
+			q0 = v3distsq(p0, q);
+			q1 = v3distsq(p1, q);
+			q2 = v3distsq(p2, q);
+			e = q1 < q0 ? p1 : p0;
+			e = q2 < (q1 < q0 ? q1 : q0) ? p2 : e;
+			v = v3add(a, v3add(v3mul(e1, k[0][i]),
+			    v3mul(e2, k[1][i])));
+			k[6][i] = k[2][i];
+			k[0][i] = v.x;
+			k[1][i] = v.y;
+			k[2][i] = v.z;
+			k[3][i] = e.x;
+			k[4][i] = e.y;
+			k[5][i] = e.z;
+		}
+		for (i = 0; i < m; i++) {
+			v = v3new(k[0][i], k[1][i], k[2][i]);
+			e = v3new(k[3][i], k[4][i], k[5][i]);
+			e = k[6][i] != 0 ? v : e;
+			k[0][i] = e.x;
+			k[1][i] = e.y;
+			k[2][i] = e.z;
+			k[3][i] = v3distsq(v3soaget(p, j + i), e);
+		}
+		memcpy(c.x + j, k[0], m * sizeof(real));
+		memcpy(c.y + j, k[1], m * sizeof(real));
+		memcpy(c.z + j, k[2], m * sizeof(real));
+		memcpy(d2 + j, k[3], m * sizeof(real));
+	}
+}
+
+static inline void
+plane3distsoa(plane3 pl, v3soa p, real *d, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		d[i] = plane3dist(pl, v3soaget(p, i));
+}
+
 #ifdef __cplusplus
 } /* namespace linalg */
 #endif
@@ -252,6 +252,1551 @@ test11(void)
 	return (0);
 }
 
+static int
+test12(void)
+{
+	static v3 a[1000];
+	static real r[1000], w[1000];
+	v3 p[4], s, lo, hi;
+	real q[4];
+	m33 cov;
+	size_t i, nblk = realnblk(1000);
+
+	for (i = 0; i < 1000; i++) {
+		a[i] = v3new((real)i, (real)(1000 - i), (real)(i % 7));
+		r[i] = (real)i;
+		w[i] = i < 500 ? 1 : 0;
+	}
+	for (i = 0; i < nblk; i++) {
+		p[i] = v3sumblk(a, 1000, i);
+		q[i] = realsumblk(r, 1000, i);
+	}
+	s = v3sum(a, 1000);
+	if (nblk != 4) return (1);
+	if (!v3eq(s, v3sumtree(p, nblk), 0.5)) return (1);
+	if (s.x != v3sumtree(p, nblk).x) return (1);
+	if (s.y != v3sumtree(p, nblk).y) return (1);
+	if (s.z != v3sumtree(p, nblk).z) return (1);
+	if (realsum(r, 1000) != realsumtree(q, nblk)) return (1);
+	if (!v3eq(s, v3new(499500, 500500, 2997), EPS)) return (1);
+	if (!v3eq(v3sumkahan(a, 1000), s, EPS)) return (1);
+	if (!realeq(realsum(r, 1000), 499500, EPS)) return (1);
+	if (!realeq(realsumkahan(r, 1000), 499500, EPS)) return (1);
+	if (!v3eq(v3centroid(a, 2), v3new(0.5, 999.5, 0.5), EPS)) return (1);
+	if (!v3eq(v3wcentroid(a, w, 1000), v3centroid(a, 500), EPS))
+		return (1);
+	cov = v3cov(a, 2);
+	if (!m33eq(cov, v3outer(v3new(0.5, -0.5, 0.5),
+	    v3new(0.5, -0.5, 0.5)), EPS)) return (1);
+	if (!v3eq(v3centroid(a, 0), v3zero(), EPS)) return (1);
+	if (!v3eq(v3wcentroid(a, w + 500, 500), v3zero(), EPS)) return (1);
+	if (!m33eq(v3cov(a, 0), m33zero(), EPS)) return (1);
+	lo = v3lower(a, 1000);
+	hi = v3upper(a, 1000);
+	if (!v3eq(lo, v3new(0, 1, 0), EPS)) return (1);
+	if (!v3eq(hi, v3new(999, 1000, 6), EPS)) return (1);
+	if (!v3eq(v3min(lo, hi), lo, EPS)) return (1);
+	if (!v3eq(v3max(lo, hi), hi, EPS)) return (1);
+	if (!realeq(reallower(r, 1000), 0, EPS)) return (1);
+	if (!realeq(realupper(r, 1000), 999, EPS)) return (1);
+	if (reallower(r, 0) != (real)HUGE_VAL) return (1);
+	if (realupper(r, 0) != -(real)HUGE_VAL) return (1);
+	if (v3lower(a, 0).y != (real)HUGE_VAL) return (1);
+	if (v3upper(a, 0).z != -(real)HUGE_VAL) return (1);
+
+	return (0);
+}
+
+static int
+test13(void)
+{
+	static v3 a[100];
+	static real x[100], y[100], z[100];
+	box3 b, c[4], q;
+	int hit[100];
+	size_t i;
+
+	for (i = 0; i < 100; i++) {
+		a[i] = v3new((real)i, (real)(i % 10), -(real)i);
+		x[i] = a[i].x;
+		y[i] = a[i].y;
+		z[i] = a[i].z;
+	}
+	b = box3of(a, 100);
+	if (!box3eq(b, box3new(v3new(0, 0, -99), v3new(99, 9, 0)), EPS))
+		return (1);
+	if (!box3eq(b, box3ofsoa(x, y, z, 100), EPS)) return (1);
+	q = box3of(a, 0);
+	if (q.lo.x != (real)HUGE_VAL || q.hi.x != -(real)HUGE_VAL) return (1);
+	if (!box3eq(box3add(box3empty(), a[5]), box3new(a[5], a[5]), EPS))
+		return (1);
+	if (box3chunks(a, 100, 0, c) != 1) return (1);
+	if (!box3eq(c[0], b, EPS)) return (1);
+	if (box3chunks(a, 100, 30, c) != 4) return (1);
+	if (!box3eq(c[3], box3new(v3new(90, 0, -99), v3new(99, 9, -90)), EPS))
+		return (1);
+	q = box3merge(box3merge(c[0], c[1]), box3merge(c[2], c[3]));
+	if (!box3eq(q, b, EPS)) return (1);
+	if (!v3eq(box3center(c[0]), v3new(14.5, 4.5, -14.5), EPS)) return (1);
+	if (!v3eq(box3extent(c[0]), v3new(29, 9, 29), EPS)) return (1);
+	q = box3new(v3new(25, 0, -45), v3new(35, 1, -25));
+	if (box3overlaps(q, c, 4, hit) != 2) return (1);
+	if (!hit[0] || !hit[1] || hit[2] || hit[3]) return (1);
+	if (box3insides(q, a, 100, hit) != 2) return (1);
+	if (!hit[30] || !hit[31] || hit[29]) return (1);
+
+	return (0);
+}
+
+static int
+test14(void)
+{
+	static real buf[9][3];
+	tri3soa s = { buf[0], buf[1], buf[2], buf[3], buf[4], buf[5],
+		      buf[6], buf[7], buf[8] };
+	ray3 r[4];
+	hit3 h[4];
+	box3 b[2];
+	real t[2];
+	size_t i;
+
+	for (i = 0; i < 3; i++) {
+		real z = (real)i + 1;
+		tri3soaset(s, i, v3new(0, 0, z), v3new(1, 0, z),
+		    v3new(0, 1, z));
+	}
+	r[0] = ray3new(v3new(0.25, 0.5, 0), v3new(0, 0, 1));
+	r[1] = ray3new(v3new(0.75, 0.75, 0), v3new(0, 0, 1));
+	r[2] = ray3new(v3new(0.25, 0.25, 4), v3new(0, 0, -1));
+	r[3] = ray3new(v3new(0.25, 0.25, 0), v3new(1, 0, 0));
+	for (i = 0; i < 4; i++)
+		h[i] = hit3none();
+	if (!ray3tris(r[0], s, 3, &h[0])) return (1);
+	if (h[0].id != 0) return (1);
+	if (!realeq(h[0].t, 1, EPS)) return (1);
+	if (!realeq(h[0].u, 0.25, EPS)) return (1);
+	if (!realeq(h[0].v, 0.5, EPS)) return (1);
+	if (ray3tris(r[1], s, 3, &h[1])) return (1);
+	if (ray3packet(r, 4, v3new(0, 0, 3), v3new(1, 0, 3), v3new(0, 1, 3),
+	    7, h) != 1) return (1);
+	if (h[2].id != 7 || h[0].id != 0) return (1);
+	if (!v3eq(ray3at(r[2], h[2].t), v3new(0.25, 0.25, 3), EPS)) return (1);
+	b[0] = box3new(v3new(-1, -1, 2), v3new(1, 1, 3));
+	b[1] = box3new(v3new(2, 2, 2), v3new(3, 3, 3));
+	if (ray3boxes(r[0], b, 2, 10, t) != 1) return (1);
+	if (!realeq(t[0], 2, EPS)) return (1);
+	if (ray3boxes(r[0], b, 2, 1, t) != 0) return (1);
+	if (ray3boxes(r[0], b, 2, (real)HUGE_VAL, t) != 1) return (1);
+	if (t[1] != (real)HUGE_VAL) return (1);
+	r[3] = ray3new(v3new(-1, 1, 0), v3new(0, (real)-0.0, 1));
+	if (!box3inside(b[0], v3new(-1, 1, 2))) return (1);
+	if (ray3boxes(r[3], b, 2, 10, t) != 1) return (1);
+	if (!realeq(t[0], 2, EPS)) return (1);
+	r[3] = ray3new(v3new(2, 2, 0), v3new(0, 0, -1));
+	if (ray3boxes(r[3], b, 2, 10, t) != 0) return (1);
+
+	return (0);
+}
+
+static int
+test15(void)
+{
+	m33 a = m33new(4,2,3,7,8,9,1,5,6);
+	m33 d = m33new(5,1,0,1,5,1,0,1,5);
+	blk33 t[6];
+	size_t row[4], col[6];
+	m33 val[6];
+	v3 x[3], y[3], z[3];
+	bsr33 m;
+
+	t[0] = blk33new(2, 0, m33trans(a));
+	t[1] = blk33new(0, 0, d);
+	t[2] = blk33new(1, 1, d);
+	t[3] = blk33new(0, 2, m33mul(a, 0.5));
+	t[4] = blk33new(2, 2, d);
+	t[5] = blk33new(0, 2, m33mul(a, 0.5));
+	x[0] = v3new(1, 2, 3);
+	x[1] = v3new(-1, 0, 1);
+	x[2] = v3new(2, -3, 5);
+	z[0] = v3add(m33v3(d, x[0]), m33v3(a, x[2]));
+	z[1] = m33v3(d, x[1]);
+	z[2] = v3add(m33tv3(a, x[0]), m33v3(d, x[2]));
+
+	m = bsr33build(t, 6, 3, 0, row, col, val);
+	if (m.nnz != 5) return (1);
+	if (row[0] != 0 || row[1] != 2 || row[2] != 3 || row[3] != 5)
+		return (1);
+	if (col[0] != 0 || col[1] != 2 || col[3] != 0 || col[4] != 2)
+		return (1);
+	if (!m33eq(val[1], a, EPS)) return (1);
+	bsr33mv(&m, x, y);
+	if (!v3eq(y[0], z[0], EPS)) return (1);
+	if (!v3eq(y[1], z[1], EPS)) return (1);
+	if (!v3eq(y[2], z[2], EPS)) return (1);
+
+	m = bsr33build(t, 6, 3, 1, row, col, val);
+	if (m.nnz != 4) return (1);
+	if (row[1] != 2 || row[2] != 3 || row[3] != 4) return (1);
+	if (col[1] != 2 || col[3] != 2) return (1);
+	if (!m33eq(val[1], a, EPS)) return (1);
+	bsr33mv(&m, x, y);
+	if (!v3eq(y[0], z[0], EPS)) return (1);
+	if (!v3eq(y[1], z[1], EPS)) return (1);
+	if (!v3eq(y[2], z[2], EPS)) return (1);
+
+	return (0);
+}
+
+static int
+cgcount(size_t iter, real res, void *arg)
+{
+	(void)res;
+	*(size_t *)arg = iter;
+	return (0);
+}
+
+static int
+test16(void)
+{
+	m33 d = m33new(6,1,0,1,6,1,0,1,6);
+	m33 o = m33new(-1,0,0,0,-1,0,0,0,-1);
+	blk33 t[10];
+	size_t row[5], col[10], i, k = 0, cnt = 0, it;
+	m33 val[10], pre[4];
+	v3 b[4], x[4], y[4], work[12];
+	bsr33 a;
+
+	for (i = 0; i < 4; i++) {
+		t[k++] = blk33new(i, i, m33add(d, m33mul(m33ident(), (real)i)));
+		if (i > 0) {
+			t[k++] = blk33new(i, i - 1, o);
+			t[k++] = blk33new(i - 1, i, o);
+		}
+		b[i] = v3new(1, (real)i, -2);
+		x[i] = v3zero();
+	}
+	a = bsr33build(t, k, 4, 1, row, col, val);
+	bsr33jacobi(&a, pre);
+	if (!m33eq(m33m33(pre[1], val[2]), m33ident(), EPS)) return (1);
+	it = bsr33cg(&a, pre, b, x, work, 100, EPS, cgcount, &cnt);
+	if (it == 0 || it > 12 || cnt != it) return (1);
+	bsr33mv(&a, x, y);
+	for (i = 0; i < 4; i++)
+		if (!v3eq(y[i], b[i], 100 * EPS)) return (1);
+	if (bsr33cg(&a, NULL, b, x, work, 100, 100 * EPS, NULL, NULL) != 0)
+		return (1);
+	if (!realeq(v3dotsum(b, b, 4), 34, EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test17(void)
+{
+	static unsigned char buf[4096 + 100];
+	arena a = arenanew(buf + 1, sizeof(buf) - 1);
+	pool p;
+	size_t mark;
+	void *b, *c;
+	real *r;
+	v3 *v;
+	m33 *m;
+	q4 *q;
+
+	if (a.size < 4096) return (1);
+	r = arenareal(&a, 3);
+	mark = arenamark(&a);
+	v = arenav3(&a, 3);
+	m = arenam33(&a, 1);
+	q = arenaq4(&a, 1);
+	if (r == NULL || v == NULL || m == NULL || q == NULL) return (1);
+	if ((size_t)v % LINALG_ALIGN || (size_t)q % LINALG_ALIGN) return (1);
+	if ((unsigned char *)v - (unsigned char *)r != LINALG_ALIGN) return (1);
+	if (arenaalloc(&a, 0) != NULL) return (1);
+	if (arenaalloc(&a, 4096) != NULL) return (1);
+	arenareset(&a, mark);
+	if (arenav3(&a, 1) != v) return (1);
+	memtouch(a.base, a.size, 1024);
+	if (a.base[1024] != 0) return (1);
+
+	p = poolnew(&a);
+	b = poolalloc(&p, 100);
+	c = poolalloc(&p, 200);
+	if (b == NULL || c == NULL || (size_t)c % LINALG_ALIGN) return (1);
+	poolfree(&p, b, 100);
+	if (poolalloc(&p, 65) != b) return (1);
+	if (poolalloc(&p, 65) == b) return (1);
+	if (poolalloc(&p, (size_t)LINALG_ALIGN << LINALG_POOLCLASSES) != NULL)
+		return (1);
+	poolfree(&p, c, (size_t)LINALG_ALIGN << LINALG_POOLCLASSES);
+
+	return (0);
+}
+
+static int
+test18(void)
+{
+	static double buf[2][512];
+	v3 pos[5];
+	q4 rot[5];
+	const trjhdr *h;
+	trjhdr *g;
+	const real *x, *w;
+	size_t i, size;
+
+	for (i = 0; i < 5; i++) {
+		pos[i] = v3new((real)i, (real)i + 1, (real)i + 2);
+		rot[i] = q4new(1, 0, 0, (real)i);
+	}
+	size = trjinit(buf[0], 5, 2, LINALG_TRJAOS, 1);
+	if (size > sizeof(buf[0]) || size % LINALG_ALIGN) return (1);
+	trjput(buf[0], 0, pos, rot);
+	trjput(buf[0], 1, pos + 1, rot + 1);
+	if ((h = trjopen(buf[0], size)) == NULL) return (1);
+	if (h->count != 5 || h->nframes != 2) return (1);
+	if (trjopen(buf[0], size - 1) != NULL) return (1);
+	if (!v3eq(trjv3(buf[0], 1)[2], pos[3], EPS)) return (1);
+	if (!q4eq(trjq4(buf[0], 0)[4], rot[4], EPS)) return (1);
+	if ((size_t)((const unsigned char *)trjq4(buf[0], 1) -
+	    (const unsigned char *)buf[0]) % LINALG_ALIGN) return (1);
+	if (trjsoa(buf[0], 0, 0) != NULL) return (1);
+
+	size = trjinit(buf[1], 5, 1, LINALG_TRJSOA, 1);
+	trjput(buf[1], 0, pos, rot);
+	if (trjopen(buf[1], size) == NULL) return (1);
+	x = trjsoa(buf[1], 0, 0);
+	w = trjsoa(buf[1], 0, 6);
+	if (!realeq(x[3], 3, EPS) || !realeq(w[3], 3, EPS)) return (1);
+	if (!realeq(trjsoa(buf[1], 0, 2)[4], 6, EPS)) return (1);
+	if (trjv3(buf[1], 0) != NULL || trjq4(buf[1], 0) != NULL) return (1);
+	if (trjsoa(buf[1], 0, 7) != NULL) return (1);
+
+	size = trjinit(buf[1], 5, 1, LINALG_TRJSOA, 0);
+	trjput(buf[1], 0, pos, rot);
+	if (trjsoa(buf[1], 0, 3) != NULL || trjq4(buf[1], 0) != NULL)
+		return (1);
+	g = (trjhdr *)(void *)buf[1];
+	g->compstride += LINALG_ALIGN;
+	if (trjopen(buf[1], size) != NULL) return (1);
+	g->compstride -= LINALG_ALIGN;
+	g->count = g->compstride / sizeof(real) + 1;
+	if (trjopen(buf[1], size) != NULL) return (1);
+	g->count = 5;
+	if (trjopen(buf[1], size) == NULL) return (1);
+	g->magic = 0;
+	if (trjopen(buf[1], size) != NULL) return (1);
+
+	size = trjinit(buf[0], 5, 2, LINALG_TRJAOS, 1);
+	g = (trjhdr *)(void *)buf[0];
+	g->count = (uint64_t)-1 / 2;
+	if (trjopen(buf[0], size) != NULL) return (1);
+	g->count = 5;
+	g->q4off = g->stride;
+	if (trjopen(buf[0], size) != NULL) return (1);
+	g->q4off = 0;
+	if (trjopen(buf[0], size) == NULL) return (1);
+	g->q4off = g->stride - LINALG_ALIGN;
+	if (trjopen(buf[0], size) != NULL) return (1);
+	g->q4off = 1;
+	if (trjopen(buf[0], size) != NULL) return (1);
+	g->q4off = 0;
+	g->stride = (uint64_t)-1 - LINALG_ALIGN + 1;
+	if (trjopen(buf[0], size) != NULL) return (1);
+	g->stride = 0;
+	if (trjopen(buf[0], size) != NULL) return (1);
+	g->count = 0;
+	g->nframes = (uint64_t)-1;
+	if (trjopen(buf[0], size) == NULL) return (1);
+
+	size = trjinit(buf[0], 5, 0, LINALG_TRJAOS, 1);
+	if (size != alignsize(sizeof(trjhdr))) return (1);
+	if (trjopen(buf[0], size) == NULL) return (1);
+	size = trjinit(buf[1], 5, 0, LINALG_TRJSOA, 1);
+	if (trjopen(buf[1], size) == NULL) return (1);
+	if (trjopen(buf[1], size - 1) != NULL) return (1);
+
+	return (0);
+}
+
+typedef struct {
+	v3 in[10], out[10];
+	size_t pos, len;
+} streamdata;
+
+static size_t
+streamsrc(void *arg, v3 *buf, size_t max)
+{
+	streamdata *d = (streamdata *)arg;
+	size_t i;
+
+	for (i = 0; i < max && d->pos < 10; i++)
+		buf[i] = d->in[d->pos++];
+	return (i);
+}
+
+static void
+streamdst(void *arg, const v3 *buf, size_t n)
+{
+	streamdata *d = (streamdata *)arg;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		d->out[d->len++] = buf[i];
+}
+
+static int
+test19(void)
+{
+	static v3 mem[2][4];
+	v3 *bufs[2] = { mem[0], mem[1] };
+	q4 q = q4new((real)M_SQRT1_2, 0, 0, (real)M_SQRT1_2);
+	streamdata d;
+	stream s;
+	ring r;
+	size_t i, v;
+
+	ringinit(&r);
+	for (i = 0; i < LINALG_RINGSIZE; i++)
+		if (!ringpush(&r, i)) return (1);
+	if (ringpush(&r, i)) return (1);
+	if (!ringpop(&r, &v) || v != 0) return (1);
+
+	if (!m33eq(q4m33(q), m33rotz((real)M_PI / 2), EPS)) return (1);
+	if (!v3eq(q4v3(q, v3new(1, 2, 3)), v3new(-2, 1, 3), EPS)) return (1);
+	for (i = 0; i < 10; i++)
+		d.in[i] = v3new((real)i, 1, 0);
+	d.pos = d.len = 0;
+	if (streaminit(&s, bufs, 0, 4, streamsrc, streamdst, &d)) return (1);
+	if (!streaminit(&s, bufs, 2, 4, streamsrc, streamdst, &d)) return (1);
+	s.m = q4m33(q4new(0, 0, 0, 1));
+	s.t = v3new(0, 0, 1);
+	streamrun(&s);
+	if (d.len != 10) return (1);
+	if (s.count[0] != 10 || s.count[1] != 10 || s.count[2] != 10)
+		return (1);
+	for (i = 0; i < 10; i++)
+		if (!v3eq(d.out[i], v3new(-(real)i, -1, 1), EPS)) return (1);
+	if (s.secs[0] < 0 || s.secs[1] < 0 || s.secs[2] < 0) return (1);
+	v3xform(m33ident(), v3zero(), d.out, d.in, 10);
+	if (!v3eq(d.in[9], d.out[9], EPS)) return (1);
+
+	d.pos = d.len = 0;
+	if (!streaminit(&s, bufs, 1, 3, streamsrc, streamdst, &d)) return (1);
+	streamrun(&s);
+	if (d.len != 10 || !v3eq(d.out[9], d.in[9], EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test20(void)
+{
+	q4 q[3], r[3];
+	static q4 qb[100];
+	static uint32_t eb[100];
+	v3 v[3], w[3];
+	uint32_t e32[3];
+	uint16_t e48[9], e16[9];
+	box3 b = box3new(v3new(-10, 0, 5), v3new(10, 1, 5));
+	real zero = 0, nan = zero / zero;
+	size_t i;
+
+	q[0] = q4div(q4new(1, 2, 3, 4), q4norm(q4new(1, 2, 3, 4)));
+	q[1] = q4div(q4new(-5, 1, 0, -2), q4norm(q4new(-5, 1, 0, -2)));
+	q[2] = q4new(0, 0, -1, 0);
+	q4enc32(q, e32, 3);
+	q4dec32(e32, r, 3);
+	for (i = 0; i < 3; i++) {
+		if (q4normsq(q4add(r[i], q[i])) < 1) r[i] = q4neg(r[i]);
+		if (!q4eq(r[i], q[i], (real)2.1e-3)) return (1);
+	}
+	q4enc48(q, e48, 3);
+	q4dec48(e48, r, 3);
+	for (i = 0; i < 3; i++) {
+		if (q4normsq(q4add(r[i], q[i])) < 1) r[i] = q4neg(r[i]);
+		if (!q4eq(r[i], q[i], (real)6.5e-5)) return (1);
+	}
+	if (!q4eq(r[2], q[2], EPS)) return (1);
+	for (i = 0; i < 100; i++) {
+		qb[i] = q4new((real)i - 50, 1, (real)(i % 7), -3);
+		qb[i] = q4div(qb[i], q4norm(qb[i]));
+	}
+	q4enc32(qb, eb, 100);
+	for (i = 0; i < 100; i++)
+		if (eb[i] != (uint32_t)q4pack(qb[i], 10)) return (1);
+	q4dec32(eb, qb, 100);
+	if (!q4eq(qb[99], q4unpack(eb[99], 10), EPS)) return (1);
+	r[0] = q4unpack(q4pack(q4new(1, nan, 0, 0), 15), 15);
+	if (!q4eq(r[0], q4new(1, 0, 0, 0), EPS)) return (1);
+
+	v[0] = v3new(-10, 0, 5);
+	v[1] = v3new((real)3.14159, 0.5, 5);
+	v[2] = v3new(20, -1, 6);
+	v3encbox(b, v, e16, 3);
+	v3decbox(b, e16, w, 3);
+	if (!v3eq(w[0], v[0], EPS)) return (1);
+	if (!v3eq(w[1], v[1], (real)1.6e-4)) return (1);
+	if (!v3eq(w[2], v3new(10, 0, 5), EPS)) return (1);
+	v[0] = v3new(nan, 1, nan);
+	v3encbox(b, v, e16, 1);
+	if (e16[0] != 0 || e16[1] != 65535 || e16[2] != 0) return (1);
+
+	v[0] = v3new(1, -2.5, 65504);
+	v[1] = v3new((real)3.14159, (real)1.0e-6, (real)-1.0e-4);
+	v[2] = v3new(1.0e6, 0, (real)-1.0e-9);
+	v3enchalf(v, e16, 3);
+	v3dechalf(e16, w, 3);
+	if (!v3eq(w[0], v[0], EPS)) return (1);
+	if (!realeq(w[1].x, v[1].x, (real)(3.2 / 2048))) return (1);
+	if (!realeq(w[1].y, v[1].y, (real)3.0e-8)) return (1);
+	if (!realeq(w[1].z, v[1].z, (real)(1.0e-4 / 2048))) return (1);
+	if (w[2].x < 65504 || w[2].y != 0) return (1);
+	if (e16[8] != 0x8000 || e16[6] != 0x7c00) return (1);
+	if (realtohalf(halftoreal(0x7e00)) != 0x7e00) return (1);
+	if (halftoreal(0x7c00) < 65504) return (1);
+#ifndef LINALG_SINGLE_PRECISION
+	if (realtohalf(1 + ldexp(1, -11) + ldexp(1, -40)) != 0x3c01) return (1);
+	if (realtohalf(ldexp(1, -25) + ldexp(1, -60)) != 0x0001) return (1);
+#endif
+	if (realtohalf(1 + (real)ldexp(1, -11)) != 0x3c00) return (1);
+	if (realtohalf(-(real)ldexp(1, -25)) != 0x8000) return (1);
+
+	return (0);
+}
+
+static int
+test21(void)
+{
+	real xyzw[8] = { 1, 2, 3, -1, 4, 5, 6, -1 };
+	real soa[6] = { 1, 4, 2, 5, 3, 6 };
+	real fm[18] = { 1, 4, 7, 2, 5, 8, 3, 6, 9,
+			9, 8, 7, 6, 5, 4, 3, 2, 1 };
+	m33 a = m33new(1,2,3,4,5,6,7,8,9);
+	v3view v = v3viewnew(xyzw, 2, 4, 1);
+	v3view w = v3viewnew(soa, 2, 1, 2);
+	m33view m = m33viewnew(fm, 2, 9, LINALG_COLMAJOR);
+	m33view mr = m33viewnew(fm, 2, 9, LINALG_ROWMAJOR);
+
+	if (!v3eq(v3viewget(v, 1), v3new(4, 5, 6), EPS)) return (1);
+	if (!v3eq(v3viewget(w, 1), v3new(4, 5, 6), EPS)) return (1);
+	if (!m33eq(m33viewget(m, 0), a, EPS)) return (1);
+	if (!m33eq(m33viewget(mr, 0), m33trans(a), EPS)) return (1);
+	if (!box3eq(v3viewbox(w), box3new(v3new(1, 2, 3), v3new(4, 5, 6)),
+	    EPS)) return (1);
+	m33viewv3(m, v, w);
+	if (!v3eq(v3viewget(w, 0), m33v3(a, v3new(1, 2, 3)), EPS)) return (1);
+	if (!realeq(xyzw[3], -1, EPS)) return (1);
+	v3viewxform(m33ident(), v3new(1, 1, 1), v, v);
+	if (!v3eq(v3viewget(v, 0), v3new(2, 3, 4), EPS)) return (1);
+	if (!realeq(xyzw[7], -1, EPS)) return (1);
+	m33viewset(m, 1, a);
+	if (!realeq(fm[10], 4, EPS)) return (1);
+	if (!m33eq(m33viewget(m, 1), a, EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test22(void)
+{
+	s33 s[2], t[2];
+	m33 r[2], vec[2];
+	v3 v[2], w[2], val[2];
+	real d[2];
+	size_t i;
+
+	s[0] = s33new(4, 5, 6, 1, 2, 3);
+	s[1] = s33add(s33mul(s33ident(), 2), s33new(0, 0, 0, 0, 0, 1));
+	r[0] = m33rotz((real)0.3);
+	r[1] = m33new(1, 2, 0, 0, 1, 0, 0, 0, 3);
+	v[0] = v[1] = v3new(1, -2, 3);
+	if (!s33eq(m33sym(s33full(s[0])), s[0], EPS)) return (1);
+	if (!s33eq(m33sym(m33new(1,2,3,4,5,6,7,8,9)), s33new(1,5,9,3,5,7),
+	    EPS)) return (1);
+	s33v3n(s, v, w, 2);
+	s33detn(s, d, 2);
+	for (i = 0; i < 2; i++) {
+		if (!v3eq(w[i], m33v3(s33full(s[i]), v[i]), EPS)) return (1);
+		if (!realeq(d[i], m33det(s33full(s[i])), 10 * EPS)) return (1);
+	}
+	if (!realeq(s33trace(s[0]), 15, EPS)) return (1);
+	s33invn(s, t, 2);
+	if (!m33eq(m33m33(s33full(s[0]), s33full(t[0])), m33ident(), EPS))
+		return (1);
+	s33congrn(r, s, t, 2);
+	for (i = 0; i < 2; i++) {
+		m33 f = m33m33(r[i], m33m33(s33full(s[i]), m33trans(r[i])));
+		if (!m33eq(s33full(t[i]), f, 10 * EPS)) return (1);
+	}
+	s33eigenn(s, val, vec, 2);
+	if (!v3eq(val[1], v3new(1, 2, 3), EPS)) return (1);
+	for (i = 0; i < 2; i++) {
+		m33 l = m33new(val[i].x, 0, 0, 0, val[i].y, 0, 0, 0, val[i].z);
+		m33 f = m33m33(vec[i], m33m33(l, m33trans(vec[i])));
+		if (!m33eq(f, s33full(s[i]), 100 * EPS)) return (1);
+		if (!m33eq(m33m33(vec[i], m33trans(vec[i])), m33ident(),
+		    100 * EPS)) return (1);
+		if (val[i].x > val[i].y || val[i].y > val[i].z) return (1);
+	}
+
+	return (0);
+}
+
+static int
+test23(void)
+{
+	q4 q = q4new(0, 0, 0, 1);
+	m33 r = m33rotx((real)M_PI / 2);
+	v3 in[3], out[3], e;
+	chain3 c;
+	size_t i;
+
+	for (i = 0; i < 3; i++)
+		in[i] = v3new((real)i, 1, 2);
+	chain3init(&c);
+	if (!chain3q4(&c, q)) return (1);
+	if (!chain3scale(&c, 2)) return (1);
+	if (!chain3move(&c, v3new(1, 0, 0))) return (1);
+	if (!chain3m33(&c, r)) return (1);
+	chain3apply(&c, in, out, 3);
+	for (i = 0; i < 3; i++) {
+		e = m33v3(r, v3add(v3mul(q4v3(q, in[i]), 2), v3new(1, 0, 0)));
+		if (!v3eq(out[i], e, 10 * EPS)) return (1);
+		if (!v3eq(af3v3(chain3fold(&c), in[i]), e, 10 * EPS))
+			return (1);
+	}
+	while (chain3push(&c, af3ident()))
+		;
+	if (c.n != LINALG_CHAINMAX) return (1);
+	if (!v3eq(af3v3(af3then(af3ident(), chain3fold(&c)), in[2]), out[2],
+	    10 * EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test24(void)
+{
+	static v3 v[512], w[512], u[512];
+	static uint64_t key[512], tkey[512], h[8];
+	static size_t perm[512], tperm[512], id[512], pid[512];
+	static uint64_t k2[512];
+	static size_t cnt[3 * 256];
+	box3 b = box3new(v3zero(), v3new(1, 1, 1));
+	size_t i, j, c;
+	unsigned shift;
+
+	if (v3morton(b, v3new(1, 0, 0), 10) != bitspread3(1023) << 2)
+		return (1);
+	if (v3morton(b, v3new(0, 0, 2), 21) != UINT64_C(0x1249249249249249))
+		return (1);
+	for (i = 0; i < 8; i++)
+		v[i] = v3new((real)(i >> 2 & 1), (real)(i >> 1 & 1),
+		    (real)(i & 1));
+	v3hilbertn(b, v, h, 8, 1);
+	for (i = 0; i < 8; i++)
+		if (h[i] > 7 || (i && h[i] == h[0])) return (1);
+	for (i = 0; i < 512; i++) {
+		j = i * 37 % 512;
+		v[i] = v3new((real)(j >> 6), (real)(j >> 3 & 7), (real)(j & 7));
+	}
+	b = box3of(v, 512);
+	v3hilbertn(b, v, key, 512, 3);
+	keysort(key, perm, 512, tkey, tperm);
+	v3permute(v, perm, w, 512);
+	for (i = 1; i < 512; i++) {
+		if (key[i] != i) return (1);
+		if (!realeq(v3distsq(w[i - 1], w[i]), 1, EPS)) return (1);
+	}
+	v3unpermute(w, perm, u, 512);
+	for (i = 0; i < 512; i++)
+		if (!v3eq(u[i], v[i], EPS)) return (1);
+	v3mortonn(b, v, key, 512, 21);
+	keysort(key, perm, 512, tkey, tperm);
+	for (i = 0; i < 512; i++)
+		id[i] = i;
+	mempermute(id, sizeof(size_t), perm, pid, 512);
+	for (i = 1; i < 512; i++)
+		if (key[i - 1] > key[i] || pid[i] != perm[i]) return (1);
+	memunpermute(pid, sizeof(size_t), perm, id, 512);
+	for (i = 0; i < 512; i++)
+		if (id[i] != i) return (1);
+
+	if (v3hilbert(b, v[5], 0) != v3hilbert(b, v[5], 1)) return (1);
+	if (v3morton(b, v[5], 64) != v3morton(b, v[5], 21)) return (1);
+	v3mortonn(b, v, key, 512, 21);
+	for (i = 0; i < 512; i++) {
+		k2[i] = key[i] >> 30;
+		id[i] = i;
+	}
+	for (shift = 0; shift < 64; shift += 8) {
+		for (c = 0; c < 3; c++)
+			keyhist(k2, c * 200, c < 2 ? c * 200 + 200 : 512, shift,
+			    cnt + 256 * c);
+		if (!keyscan(cnt, 3))
+			continue;
+		for (c = 3; c-- > 0;)
+			keyscatter(k2, id, c * 200, c < 2 ? c * 200 + 200 : 512,
+			    shift, cnt + 256 * c, tkey, tperm);
+		memcpy(k2, tkey, sizeof(k2));
+		memcpy(id, tperm, sizeof(id));
+	}
+	for (i = 0; i < 512; i++)
+		key[i] >>= 30;
+	keysort(key, perm, 512, tkey, tperm);
+	for (i = 0; i < 512; i++)
+		if (k2[i] != key[i] || id[i] != perm[i]) return (1);
+
+	return (0);
+}
+
+static int
+test25(void)
+{
+	static v3 p[300], orig[300], q[50];
+	static size_t idx[300], out[300], nn[50];
+	static unsigned char axis[300];
+	real d2[300], qd[50], best;
+	size_t i, j, k, cnt;
+	kd3 t;
+
+	for (i = 0; i < 300; i++)
+		orig[i] = p[i] = v3new((real)(i * 37 % 101) / 10,
+		    (real)(i * i % 17), (real)(i % 3));
+	for (i = 0; i < 50; i++)
+		q[i] = v3new((real)(i * 7 % 13), (real)(i % 17), (real)i / 25);
+	t = kd3build(p, idx, axis, 300);
+	for (i = 0; i < 300; i++)
+		if (!v3eq(p[i], orig[idx[i]], EPS)) return (1);
+	kd3nearestn(&t, q, 50, nn, qd);
+	for (i = 0; i < 50; i++) {
+		best = v3distsq(q[i], orig[0]);
+		for (j = 1; j < 300; j++)
+			if (v3distsq(q[i], orig[j]) < best)
+				best = v3distsq(q[i], orig[j]);
+		if (!realeq(qd[i], best, EPS)) return (1);
+		if (!realeq(v3distsq(q[i], orig[nn[i]]), best, EPS)) return (1);
+
+		k = kd3knn(&t, q[i], 10, out, d2);
+		if (k != 10 || !realeq(d2[0], best, EPS)) return (1);
+		for (j = 0, cnt = 0; j < 300; j++)
+			if (v3distsq(q[i], orig[j]) < d2[9]) cnt++;
+		if (cnt > 9) return (1);
+		for (j = 1; j < 10; j++)
+			if (d2[j - 1] > d2[j]) return (1);
+
+		k = kd3radius(&t, q[i], 2, out, 300);
+		for (j = 0, cnt = 0; j < 300; j++)
+			if (v3distsq(q[i], orig[j]) <= 4) cnt++;
+		if (k != cnt) return (1);
+		for (j = 0; j < k; j++)
+			if (v3distsq(q[i], orig[out[j]]) > 4) return (1);
+		if (kd3radius(&t, q[i], 2, out, 0) != cnt) return (1);
+	}
+
+	return (0);
+}
+
+static int
+test26(void)
+{
+	m33 a[2];
+	m22 c[2];
+	v3 b[2], e;
+	v2 d[2];
+	double x[6], y[4];
+	irinfo info[2], one;
+	size_t i;
+
+	a[0] = m33new(4,2,3,7,8,9,1,5,6);
+	a[1] = m33new((real)0.1, 1, 0, 1, 0, 0, 0, 0, (real)1.0e-3);
+	b[0] = v3new(11,13,17);
+	b[1] = v3new(1, 2, 3);
+	c[0] = m22new(1,2,3,4);
+	c[1] = m22new(1, 1, 1, 1);
+	d[0] = d[1] = v2new(7,9);
+	m33solveirn(a, b, x, info, 2, 10, 1.0e-15);
+	for (i = 0; i < 2; i++) {
+		e = v3new((real)x[3 * i], (real)x[3 * i + 1], (real)x[3 * i + 2]);
+		if (!info[i].ok || info[i].res > 1.0e-15) return (1);
+		if (!v3eq(m33v3(a[i], e), b[i], 100 * EPS)) return (1);
+		if (!v3eq(e, m33solve(a[i], b[i]), 10000 * EPS)) return (1);
+	}
+	if (fabs(x[0] + 10.0 / 9) > 1.0e-14) return (1);
+	m22solveirn(c, d, y, info, 2, 10, 1.0e-15);
+	if (!info[0].ok || info[1].ok || info[1].iters != 10) return (1);
+	if (fabs(y[0] + 5) > 1.0e-14 || fabs(y[1] - 6) > 1.0e-14) return (1);
+	m33solveir(a[0], b[0], x, 0, 1.0e-15, &one);
+	e = m33solve(a[0], b[0]);
+	if (one.iters != 0 || one.res > (double)(100 * EPS)) return (1);
+	if (x[0] != (double)e.x || x[1] != (double)e.y || x[2] != (double)e.z)
+		return (1);
+	m22solveir(c[0], d[0], y, 10, 1.0e-15, NULL);
+	if (fabs(y[0] + 5) > 1.0e-14 || fabs(y[1] - 6) > 1.0e-14) return (1);
+
+	return (0);
+}
+
+#ifdef LINALG_PROFILE
+static int
+profread(const profstat *s, int json, char *buf, size_t size)
+{
+	FILE *f;
+	size_t n;
+
+	if ((f = tmpfile()) == NULL) return (1);
+	profdump(f, s, json);
+	rewind(f);
+	n = fread(buf, 1, size - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+	return (0);
+}
+
+static int
+test27(void)
+{
+	profstat s, t;
+	v3 in[2], out[2];
+	char buf[256], inv[32];
+	unsigned long fl = 27 + 1 + 9;
+
+	profreset();
+	in[0] = v3new(1, 2, 3);
+	in[1] = v3new(4, 5, 6);
+	m33inv(m33ident());
+	v3xform(m33ident(), v3zero(), in, out, 2);
+	profsnap(&s);
+	if (s.calls[LINALG_P_M33INV] != 1) return (1);
+	if (s.flops[LINALG_P_M33INV] != fl) return (1);
+	if (s.calls[LINALG_P_M33DET] != 1) return (1);
+	if (s.calls[LINALG_P_M33V3] != 2) return (1);
+	if (s.calls[LINALG_P_V3XFORM] != 1) return (1);
+	if (s.flops[LINALG_P_V3XFORM] != 6) return (1);
+	if (s.calls[LINALG_P_Q4Q4] != 0) return (1);
+	t = s;
+	profadd(&t, &s);
+	if (t.calls[LINALG_P_M33V3] != 4) return (1);
+	if (t.flops[LINALG_P_M33V3] != 60) return (1);
+	if (strcmp(profname(LINALG_P_M33INV), "m33inv") != 0) return (1);
+	if (profread(&s, 1, buf, sizeof(buf))) return (1);
+	if (buf[0] != '{' || buf[strlen(buf) - 2] != '}') return (1);
+	if (strstr(buf, "\"m33inv\":{\"calls\":1,") == NULL) return (1);
+	if (strstr(buf, "q4q4") != NULL) return (1);
+	if (profread(&s, 0, buf, sizeof(buf))) return (1);
+	if (strncmp(buf, "m33v3 ", 6) != 0) return (1);
+	if (strstr(buf, "  2 calls ") == NULL) return (1);
+	sprintf(inv, "  %lu flops ", fl);
+	if (strstr(buf, inv) == NULL) return (1);
+	if (strstr(buf, "q4q4") != NULL) return (1);
+	profclose();
+	profreset();
+	profsnap(&s);
+	if (s.calls[LINALG_P_M33INV] != 0) return (1);
+	v2unit(v2new(3, 4));
+	v3unit(v3new(1, 2, 2));
+	m22inv(m22ident());
+	profsnap(&s);
+	if (s.flops[LINALG_P_V2UNIT] != 3 + 1 + 2) return (1);
+	if (s.flops[LINALG_P_V3UNIT] != 3 || s.flops[LINALG_P_V3LEN] != 1)
+		return (1);
+	if (s.flops[LINALG_P_V3DOT] != 5) return (1);
+	if (s.flops[LINALG_P_M22INV] != 2 + 3 + 1 + 4) return (1);
+
+	return (0);
+}
+#endif
+
+static int
+test28(void)
+{
+	/* pairs of a chain 0-1-2-3-4 and a triangle 5-6-7 */
+	size_t conn[] = { 0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 5 };
+	size_t mark[8], color[7], start[8], order[7], idx[2];
+	uint64_t mask[8];
+	size_t i, c, nc;
+	v3 out[8], ref[8], val[2], f;
+	real r = 1;
+	m33 m = m33zero();
+	scat3 s;
+
+	realatomicadd(&r, 2);
+	m33atomicadd(&m, m33ident());
+	if (!realeq(r, 3, EPS) || !m33eq(m, m33ident(), EPS)) return (1);
+	nc = colorgreedy(conn, 2, 7, 8, mask, color);
+	if (nc != 3) return (1);
+	colorgroup(color, 7, nc, start, order);
+	if (start[0] != 0 || start[nc] != 7) return (1);
+	for (i = 0; i < 8; i++) {
+		out[i] = v3zero();
+		ref[i] = v3zero();
+		mark[i] = 0;
+	}
+	for (c = 0; c < nc; c++) {
+		for (i = start[c]; i < start[c + 1]; i++) {
+			if (color[order[i]] != c) return (1);
+			if (mark[conn[2 * order[i]]] == c + 1 ||
+			    mark[conn[2 * order[i] + 1]] == c + 1) return (1);
+			mark[conn[2 * order[i]]] = c + 1;
+			mark[conn[2 * order[i] + 1]] = c + 1;
+		}
+	}
+	scat3init(&s, idx, val, 2);
+	for (i = 0; i < 7; i++) {
+		f = v3new((real)i, 1, (real)-1);
+		v3atomicadd(&ref[conn[2 * i]], f);
+		v3atomicadd(&ref[conn[2 * i + 1]], v3neg(f));
+		if (!scat3add(&s, conn[2 * i], f)) {
+			scat3flush(&s, out);
+			scat3add(&s, conn[2 * i], f);
+		}
+		if (!scat3add(&s, conn[2 * i + 1], v3neg(f))) {
+			scat3flushatomic(&s, out);
+			scat3add(&s, conn[2 * i + 1], v3neg(f));
+		}
+	}
+	scat3flush(&s, out);
+	if (s.n != 0) return (1);
+	for (i = 0; i < 8; i++)
+		if (!v3eq(out[i], ref[i], EPS)) return (1);
+	if (!v3eq(ref[1], v3new(1, 0, 0), EPS)) return (1);
+	scat3init(&s, idx, val, 2);
+	if (!scat3add(&s, 3, f) || !scat3add(&s, 3, f) || s.n != 1) return (1);
+	if (!scat3add(&s, 4, f) || scat3add(&s, 3, f)) return (1);
+	if (!v3eq(val[0], v3mul(f, 2), EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test29(void)
+{
+	m33 m[4], r;
+	real e[9][4], f[9][4], g[4][3], h[4][3], det[4], rc[4];
+	m22 p[3], q;
+	unsigned char sing[4];
+	static real big[9][150];
+	m33soa a, b;
+	m22soa c, d;
+	size_t i, k;
+
+	m[0] = m33ident();
+	m[1] = m33new(1, 0, 0, 0, 1, 0, 0, 0, (real)1.0e-3);
+	m[2] = m33new(2, 1, 0, 1, 3, 1, 0, 1, 4);
+	m[3] = m33new(1, 2, 3, 2, 4, 6, 1, 1, 1);
+	a.xx = e[0];
+	a.xy = e[1];
+	a.xz = e[2];
+	a.yx = e[3];
+	a.yy = e[4];
+	a.yz = e[5];
+	a.zx = e[6];
+	a.zy = e[7];
+	a.zz = e[8];
+	b.xx = f[0];
+	b.xy = f[1];
+	b.xz = f[2];
+	b.yx = f[3];
+	b.yy = f[4];
+	b.yz = f[5];
+	b.zx = f[6];
+	b.zy = f[7];
+	b.zz = f[8];
+	for (i = 0; i < 4; i++) {
+		e[0][i] = m[i].xx;
+		e[1][i] = m[i].xy;
+		e[2][i] = m[i].xz;
+		e[3][i] = m[i].yx;
+		e[4][i] = m[i].yy;
+		e[5][i] = m[i].yz;
+		e[6][i] = m[i].zx;
+		e[7][i] = m[i].zy;
+		e[8][i] = m[i].zz;
+	}
+	m33detsoa(a, det, 4);
+	for (i = 0; i < 4; i++)
+		if (!realeq(det[i], m33det(m[i]), EPS)) return (1);
+	if (m33invsoa(a, b, det, rc, sing, 4, (real)1.0e-5) != 1) return (1);
+	if (sing[0] || sing[1] || sing[2] || !sing[3]) return (1);
+	if (!realeq(rc[0], 1, EPS) || !realeq(rc[1], (real)1.0e-3, EPS) ||
+	    rc[3] != 0 || !realeq(det[2], 18, EPS)) return (1);
+	for (i = 0; i < 3; i++) {
+		r = m33new(f[0][i], f[1][i], f[2][i], f[3][i], f[4][i],
+		    f[5][i], f[6][i], f[7][i], f[8][i]);
+		if (!m33eq(r, m33inv(m[i]), 10 * EPS)) return (1);
+	}
+	for (i = 0; i < 9; i++)
+		if (f[i][3] != 0) return (1);
+	if (m33invsoa(a, b, NULL, rc, sing, 4, 0) != 1 || !sing[3]) return (1);
+	for (i = 0; i < 9; i++)
+		if (f[i][3] != 0 || rc[3] != 0) return (1);
+	if (m33invsoa(a, a, NULL, NULL, NULL, 4, (real)1.0e-5) != 1) return (1);
+	if (!realeq(e[8][1], 1000, 1000 * EPS)) return (1);
+	a.xx = big[0];
+	a.xy = big[1];
+	a.xz = big[2];
+	a.yx = big[3];
+	a.yy = big[4];
+	a.yz = big[5];
+	a.zx = big[6];
+	a.zy = big[7];
+	a.zz = big[8];
+	for (i = 0; i < 150; i++)
+		for (k = 0; k < 9; k++)
+			big[k][i] = ((real *)&m[i % 4])[k];
+	if (m33invsoa(a, a, NULL, NULL, NULL, 150, (real)1.0e-5) != 37)
+		return (1);
+	for (i = 0; i < 150; i++) {
+		r = i % 4 == 3 ? m33zero() : m33inv(m[i % 4]);
+		for (k = 0; k < 9; k++)
+			if (!realeq(big[k][i], ((real *)&r)[k], 1000 * EPS))
+				return (1);
+	}
+
+	p[0] = m22new(4, 0, 0, 2);
+	p[1] = m22new(1, 2, 3, 4);
+	p[2] = m22new(1, 2, 2, 4);
+	c.xx = g[0];
+	c.xy = g[1];
+	c.yx = g[2];
+	c.yy = g[3];
+	d.xx = h[0];
+	d.xy = h[1];
+	d.yx = h[2];
+	d.yy = h[3];
+	for (i = 0; i < 3; i++) {
+		g[0][i] = p[i].xx;
+		g[1][i] = p[i].xy;
+		g[2][i] = p[i].yx;
+		g[3][i] = p[i].yy;
+	}
+	m22detsoa(c, det, 3);
+	if (!realeq(det[1], -2, EPS) || det[2] != 0) return (1);
+	if (m22invsoa(c, d, det, rc, sing, 3, (real)1.0e-5) != 1) return (1);
+	if (sing[0] || sing[1] || !sing[2] || !realeq(rc[0], (real)0.5, EPS))
+		return (1);
+	for (i = 0; i < 2; i++) {
+		q = m22new(h[0][i], h[1][i], h[2][i], h[3][i]);
+		if (!m22eq(q, m22inv(p[i]), EPS)) return (1);
+	}
+	if (h[0][2] != 0 || h[3][2] != 0 || rc[2] != 0) return (1);
+	if (m22invsoa(c, d, NULL, rc, sing, 3, 0) != 1 || !sing[2]) return (1);
+	if (h[0][2] != 0 || h[1][2] != 0 || rc[2] != 0) return (1);
+	if (m22invsoa(c, c, NULL, NULL, NULL, 3, (real)1.0e-5) != 1) return (1);
+	if (!realeq(g[0][0], (real)0.25, EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test30(void)
+{
+	real qw[3], qx[3], qy[3], qz[3], wx[3], wy[3], wz[3];
+	real pw[3], px[3], py[3], pz[3];
+	q4soa q, p;
+	v3soa w;
+	q4 r, e;
+	m33 m;
+	size_t i;
+
+	q.w = qw;
+	q.x = qx;
+	q.y = qy;
+	q.z = qz;
+	p.w = pw;
+	p.x = px;
+	p.y = py;
+	p.z = pz;
+	w.x = wx;
+	w.y = wy;
+	w.z = wz;
+	/* a half turn about z in one second */
+	r = q4integrate(q4new(1, 0, 0, 0), v3new(0, 0, (real)M_PI), 1);
+	if (!q4eq(r, q4new(0, 0, 0, 1), 10 * EPS)) return (1);
+	if (!q4eq(q4exp(v3new(0, (real)1.0e-6, 0)),
+	    q4new(1, 0, (real)1.0e-6, 0), (real)1.0e-9)) return (1);
+	for (i = 0; i < 3; i++) {
+		q4soaset(q, i, q4new(1, 0, 0, 0));
+		q4soaset(p, i, q4new(1, 0, 0, 0));
+		v3soaset(w, i, v3new((real)i, 1, 0));
+	}
+	q4integratesoa(q, w, (real)0.01, 3);
+	q4stepsoa(p, w, (real)0.01, 4, 3);
+	for (i = 0; i < 3; i++) {
+		e = q4integrate(q4new(1, 0, 0, 0), v3soaget(w, i), (real)0.01);
+		if (!q4eq(q4soaget(q, i), e, 10 * EPS)) return (1);
+		if (!q4eq(q4soaget(p, i), e, (real)1.0e-6)) return (1);
+	}
+	q4stepsoa(q4soashift(p, 1), v3soashift(w, 1), (real)0.01, 1, 2);
+	if (!q4eq(q4soaget(p, 0), q4soaget(q, 0), (real)1.0e-6)) return (1);
+	if (q4normsq(q4soaget(p, 2)) <= 1) return (1);
+	q4renormsoa(p, 3);
+	for (i = 0; i < 3; i++)
+		if (!realeq(q4norm(q4soaget(p, i)), 1, 10 * EPS)) return (1);
+	if (!realeq(realrsqrt(4), (real)0.5, EPS)) return (1);
+	if (!realeq(realrsqrt((real)1.0e-6), 1000, 1000 * EPS)) return (1);
+	if (!realeq(realrsqrt((real)1.0e-36) * (real)1.0e-18, 1, 2 * EPS))
+		return (1);
+	if (!realeq(realrsqrt((real)1.0e36) * (real)1.0e18, 1, 2 * EPS))
+		return (1);
+#ifndef LINALG_SINGLE_PRECISION
+	if (!realeq(realrsqrt(1.0e-300) * 1.0e-150, 1, 2 * EPS)) return (1);
+	if (!realeq(realrsqrt(1.0e300) * 1.0e150, 1, 2 * EPS)) return (1);
+#endif
+	m = q4m33(q4mul(q4new(1, 2, 3, 4), 1 / (real)sqrt(30.0)));
+	m.xy += (real)1.0e-3;
+	m.zz -= (real)2.0e-3;
+	m = m33orthon(m, 4);
+	if (!m33eq(m33m33(m33trans(m), m), m33ident(), 10 * EPS)) return (1);
+	m33orthonn(&m, 1, 1);
+	if (!m33eq(m33m33(m33trans(m), m), m33ident(), 10 * EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test31(void)
+{
+	real x[3], y[3], ox[3], oy[3];
+	v2 in[3], out[3], val, s;
+	m22 m[3], u, v, r, p, vec;
+	v2soa a, b;
+	size_t i;
+
+	a.x = x;
+	a.y = y;
+	b.x = ox;
+	b.y = oy;
+	if (!m22eq(m22rotcs((real)0.6, (real)0.8),
+	    m22rot((real)atan2(0.8, 0.6)), EPS)) return (1);
+	for (i = 0; i < 3; i++) {
+		in[i] = v2new((real)i, 1);
+		v2soaset(a, i, in[i]);
+	}
+	v2xform(m22rot((real)M_PI / 2), v2new(1, 0), in, out, 3);
+	v2xformsoa(m22rot((real)M_PI / 2), v2new(1, 0), v2soashift(a, 1),
+	    v2soashift(b, 1), 2);
+	if (!v2eq(out[2], v2new(0, 2), EPS) ||
+	    !v2eq(v2soaget(b, 2), out[2], EPS)) return (1);
+	if (!v2eq(v2angle(v2zero()), v2new(1, 0), EPS) ||
+	    !v2eq(v2angle(v2new(0, 2)), v2new(0, 1), EPS)) return (1);
+	if (!v2eq(v2halfangle(v2new(-1, 0)), v2new(0, 1), EPS)) return (1);
+	m[0] = m22new(2, 1, 1, 2);
+	m[1] = m22new(3, 0, 0, -1);
+	m[2] = m22new(1, 2, 3, -4);
+	m22symeigen(m[0], &val, &vec);
+	if (!v2eq(val, v2new(1, 3), EPS) ||
+	    !realeq(m22det(vec), 1, EPS) ||
+	    !v2eq(m22v2(m[0], m22colx(vec)), m22colx(vec), EPS) ||
+	    !v2eq(m22v2(m[0], m22coly(vec)), v2mul(m22coly(vec), 3), EPS))
+		return (1);
+	m22symeigenn(m, &val, &vec, 1);
+	m22symeigen(m[1], &val, &vec);
+	if (!v2eq(val, v2new(-1, 3), EPS) ||
+	    !m22eq(m22m22(m22m22(vec, m22new(-1, 0, 0, 3)), m22trans(vec)),
+	    m[1], 10 * EPS)) return (1);
+	for (i = 0; i < 3; i++) {
+		m22svd(m[i], &u, &s, &v);
+		if (!realeq(m22det(u), 1, 10 * EPS) ||
+		    !realeq(m22det(v), 1, 10 * EPS)) return (1);
+		if (s.x < (real)fabs((double)s.y) ||
+		    !realeq(s.x * s.y, m22det(m[i]), 100 * EPS)) return (1);
+		if (!m22eq(m22m22(m22m22(u, m22new(s.x, 0, 0, s.y)),
+		    m22trans(v)), m[i], 100 * EPS)) return (1);
+		m22polar(m[i], &r, &p);
+		if (!realeq(m22det(r), 1, 10 * EPS) || p.xy != p.yx ||
+		    !m22eq(m22m22(r, p), m[i], 100 * EPS)) return (1);
+	}
+	m22svdn(m, &u, &s, &v, 1);
+	m22polarn(m, &r, &p, 1);
+	if (!realeq(s.x, 3, 10 * EPS) || !m22eq(r, m22ident(), EPS)) return (1);
+
+	return (0);
+}
+
+static int
+test32(void)
+{
+	pbc3 o = pbc3ortho(v3new(10, 10, 10));
+	pbc3 t = pbc3new(m33new(10, 2, 1, 0, 10, 3, 0, 0, 10));
+	v3 a[150], b[150], d[150], s;
+	real d2[150], e2[150], l;
+	size_t i;
+	int j;
+
+	if (!o.ortho || t.ortho) return (1);
+	if (!v3eq(pbc3delta(&o, v3new(1, 1, 1), v3new(9, 9, 9)),
+	    v3new(2, 2, 2), EPS)) return (1);
+	if (!v3eq(pbc3wrap(&o, v3new(-1, 11, 25)), v3new(9, 1, 5), 10 * EPS))
+		return (1);
+	a[0] = v3new(1, 1, 1);
+	a[1] = v3new(5, 5, 5);
+	b[0] = v3add(a[0], v3new((real)1.1, (real)3.2, (real)9.8));
+	b[1] = v3add(a[1], v3new((real)-11.9, (real)-0.1, 0));
+	pbc3deltan(&t, a, b, d, 2);
+	if (!v3eq(d[0], v3new((real)-0.1, (real)-0.2, (real)0.2), 100 * EPS) ||
+	    !v3eq(d[1], v3new((real)1.9, (real)0.1, 0), 100 * EPS)) return (1);
+	pbc3distsqn(&t, a, b, d2, 2);
+	if (!realeq(d2[0], (real)0.09, 100 * EPS) ||
+	    !realeq(pbc3dist(&t, a[1], b[1]), v3len(d[1]), 100 * EPS))
+		return (1);
+	pbc3distsqto(&o, v3zero(), a, d2, 2);
+	if (!realeq(d2[0], 3, EPS) || !realeq(d2[1], 75, 100 * EPS)) return (1);
+	d[0] = b[0];
+	d[1] = b[1];
+	pbc3wrapn(&t, d, 2);
+	for (i = 0; i < 2; i++) {
+		s = m33v3(t.hinv, d[i]);
+		if (s.x < 0 || s.x >= 1 || s.y < 0 || s.y >= 1 ||
+		    s.z < 0 || s.z >= 1) return (1);
+		s = m33v3(t.hinv, v3sub(d[i], b[i]));
+		if (!v3eq(s, v3new((real)floor((double)s.x + 0.5),
+		    (real)floor((double)s.y + 0.5),
+		    (real)floor((double)s.z + 0.5)), 100 * EPS)) return (1);
+	}
+	if (!realeq(pbc3distsq(&o, v3new(0, 0, 0), v3new(0, 0, 6)), 16,
+	    100 * EPS)) return (1);
+	for (i = 0; i < 150; i++) {
+		a[i] = v3new((real)(i * 37 % 101) * (real)0.3 - 15,
+		    (real)(i * 53 % 103) * (real)0.29 - 15,
+		    (real)(i * 71 % 107) * (real)0.28 - 15);
+		b[i] = v3zero();
+	}
+	a[0] = v3new((real)5.48, (real)3.47, (real)-5.02);
+	pbc3deltan(&t, a, b, d, 150);
+	pbc3distsqn(&t, a, b, d2, 150);
+	pbc3distsqto(&t, v3zero(), a, e2, 150);
+	for (i = 0; i < 150; i++) {
+		l = v3lensq(a[i]);
+		for (j = 0; j < 343; j++)
+			l = -realmax(-l, -v3lensq(v3add(a[i], m33v3(t.h,
+			    v3new((real)(j / 49 - 3), (real)(j / 7 % 7 - 3),
+			    (real)(j % 7 - 3))))));
+		if (!realeq(pbc3distsq(&t, a[i], b[i]), l, 100 * EPS) ||
+		    !realeq(v3lensq(d[i]), l, 100 * EPS) ||
+		    !realeq(d2[i], l, 100 * EPS) ||
+		    !realeq(e2[i], l, 100 * EPS)) return (1);
+		s = m33v3(t.hinv, v3sub(d[i], a[i]));
+		if (!v3eq(s, v3new((real)floor((double)s.x + 0.5),
+		    (real)floor((double)s.y + 0.5),
+		    (real)floor((double)s.z + 0.5)), 100 * EPS)) return (1);
+	}
+	if (!realeq(d2[0], (real)57.33, (real)0.01)) return (1);
+
+	return (0);
+}
+
+static int
+test33(void)
+{
+	uint32_t c[4] = { 0, 0, 0, 0 }, k[2] = { 0, 0 }, b[4];
+	rng g = rngnew(42, 7);
+	real u[10], w[7];
+	v3 v[256], m = v3zero();
+	q4 q[256];
+	size_t i;
+
+	philox4x32(c, k);
+	if (c[0] != 0x6627e8d5u || c[1] != 0xe169c58du ||
+	    c[2] != 0xbc57ac4cu || c[3] != 0x9b00dbd8u) return (1);
+	if (rnguniform(0) != 0 || rnguniform(0xffffffffu) >= 1) return (1);
+	rnguniformn(g, 0, u, 10);
+	rnguniformn(g, 3, w, 7);
+	for (i = 0; i < 7; i++)
+		if (u[i + 3] != w[i] || u[i] < 0 || u[i] >= 1) return (1);
+	rnguniformn(rngnew(42, 8), 0, w, 1);
+	if (u[0] == w[0]) return (1);
+	v3randunitn(g, 0, v, 256);
+	rngblock(g, 100, b);
+	if (!v3eq(v3randunit(b), v[100], EPS)) return (1);
+	for (i = 0; i < 256; i++) {
+		if (!realeq(v3len(v[i]), 1, 10 * EPS)) return (1);
+		m = v3add(m, v[i]);
+	}
+	if (v3len(m) > 40) return (1);
+	q4randunitn(g, 0, q, 256);
+	m = v3zero();
+	for (i = 0; i < 256; i++) {
+		if (!realeq(q4norm(q[i]), 1, 10 * EPS)) return (1);
+		m = v3add(m, q4v3(q[i], v3new(0, 0, 1)));
+	}
+	if (v3len(m) > 40) return (1);
+	q4randsmalln(g, 0, (real)0.1, q, 256);
+	for (i = 0; i < 256; i++)
+		if (!realeq(q4norm(q[i]), 1, 10 * EPS) ||
+		    q[i].w < (real)cos(0.05)) return (1);
+
+	return (0);
+}
+
+static int
+test34(void)
+{
+	v3 a = v3new(1, 2, 2), c = v3new(3, -1, 2), u;
+	v3d x = v3dvar(a, 0), y;
+	q4 q = q4mul(q4new(1, 2, 3, 4), 1 / (real)sqrt(30.0));
+	dual f, t = dualvar((real)0.5, 1);
+	m33 j, m = m33new(2, 1, 0, -1, 3, 2, 1, 0, 4);
+	m33d md;
+	q4d qd;
+
+	/* 1 / |a - c| and its gradient -(a - c) / |a - c|^3 */
+	f = dualdiv(dualnew(1), v3dlen(v3dsub(x, v3dconst(c))));
+	u = v3sub(a, c);
+	if (!realeq(f.v, 1 / v3len(u), EPS) ||
+	    !v3eq(dualgrad(f, 0), v3div(v3neg(u),
+	    v3len(u) * v3lensq(u)), EPS)) return (1);
+	y = v3dunit(x);
+	u = v3unit(a);
+	if (!v3eq(v3dval(y), u, EPS) ||
+	    !m33eq(v3djac(y, 0), m33div(m33sub(m33ident(), v3outer(u, u)),
+	    3), EPS)) return (1);
+	j = v3djac(v3dcross(x, v3dconst(c)), 0);
+	if (!m33eq(j, m33new(0, c.z, -c.y, -c.z, 0, c.x, c.y, -c.x, 0), EPS))
+		return (1);
+	if (!m33eq(v3djac(m33v3d(m33rotz(1), x), 0), m33rotz(1), EPS) ||
+	    !m33eq(v3djac(q4v3d(q, x), 0), q4m33(q), 10 * EPS)) return (1);
+	y = v3dneg(v3dscale(v3dadd(x, x), (real)0.5));
+	if (!m33eq(v3djac(y, 0), m33neg(m33ident()), EPS)) return (1);
+	y = v3dmul(x, t);
+	if (!v3eq(v3dval(y), v3mul(a, (real)0.5), EPS) ||
+	    !realeq(y.z.d[1], 2, EPS) || !realeq(y.z.d[2], (real)0.5, EPS))
+		return (1);
+	f = dualsub(dualsin(t), dualcos(t));
+	if (!realeq(f.v, (real)(sin(0.5) - cos(0.5)), EPS) ||
+	    !realeq(f.d[1], (real)(cos(0.5) + sin(0.5)), EPS) ||
+	    f.d[0] != 0) return (1);
+	f = dualmul(t, dualneg(t));
+	if (!realeq(f.d[1], -1, EPS)) return (1);
+	if (dualtan(t, LINALG_DUALN) != 0 ||
+	    dualvar(1, LINALG_DUALN).d[0] != 0) return (1);
+	md = m33dconst(m);
+	md.xx = t;
+	f = m33ddet(md);
+	if (!realeq(f.v, m33det(m33dval(md)), EPS) ||
+	    !realeq(f.d[1], m.yy * m.zz - m.yz * m.zy, EPS)) return (1);
+	if (!m33eq(m33dval(m33dm33d(md, m33dtrans(md))),
+	    m33m33(m33dval(md), m33trans(m33dval(md))), EPS)) return (1);
+	if (!m33eq(v3djac(m33dv3d(m33dconst(m), x), 0), m, EPS)) return (1);
+	qd = q4dq4d(q4dnew(t, dualnew(q.x), dualnew(q.y), dualnew(q.z)),
+	    q4dconj(q4dconst(q)));
+	if (!q4eq(q4dval(qd), q4q4(q4new((real)0.5, q.x, q.y, q.z),
+	    q4conj(q)), EPS) || !realeq(qd.w.d[1], q.w, EPS) ||
+	    !realeq(qd.x.d[1], -q.x, EPS) || !realeq(qd.z.d[1], -q.z, EPS))
+		return (1);
+	qd = q4dunit(q4dvar(q4new(1, 2, 3, 4), 0));
+	f = q4dnormsq(qd);
+	if (!realeq(f.v, 1, EPS) || !v3eq(dualgrad(f, 0), v3zero(), EPS))
+		return (1);
+	y = q4dv3d(q4dconst(q), x);
+	if (!v3eq(v3dval(y), q4v3(q, a), EPS) ||
+	    !m33eq(v3djac(y, 0), q4m33(q), 10 * EPS)) return (1);
+	y = q4dv3d(q4dvar(q, 0), v3dconst(c));
+	if (!v3eq(v3dval(y), q4v3(q, c), 10 * EPS) ||
+	    !realeq(y.x.d[0], 2 * (q.y * c.z - q.z * c.y), 10 * EPS))
+		return (1);
+
+	return (0);
+}
+
+static int
+test35(void)
+{
+	real edge2[9], rdf[8], d2;
+	uint32_t look[4 * 8 + 1];
+	uint64_t c[8], t[8];
+	v3 a[100], b[2];
+	pbc3 p = pbc3ortho(v3new(4, 4, 4));
+	pbc3 s = pbc3new(m33new(10, 2, 1, 0, 10, 3, 0, 0, 10));
+	hist3 h;
+	size_t i, j;
+
+	hist3init(&h, 4, 8, edge2, look);
+	if (hist3bin(&h, 0) != 0 || hist3bin(&h, (real)0.25) != 1 ||
+	    hist3bin(&h, (real)0.249) != 0 || hist3bin(&h, (real)15.99) != 7 ||
+	    hist3bin(&h, 16) != 8 || hist3bin(&h, 100) != 8) return (1);
+	for (i = 0; i < 1000; i++) {
+		d2 = (real)i * (real)0.01597 + (real)0.0001;
+		if (hist3bin(&h, d2) != (size_t)(2 * sqrt((double)d2)))
+			return (1);
+	}
+	for (i = 0; i < 4; i++)
+		a[i] = v3new((real)i, 0, 0);
+	hist3clear(c, 8);
+	hist3clear(t, 8);
+	hist3self(&h, NULL, a, 4, 0, 2, c);
+	hist3self(&h, NULL, a, 4, 2, 4, t);
+	hist3merge(c, t, 8);
+	if (c[2] != 3 || c[4] != 2 || c[6] != 1 || c[0] != 0) return (1);
+	hist3clear(c, 8);
+	hist3self(&h, &p, a, 4, 0, 4, c);
+	if (c[2] != 4 || c[4] != 2 || c[6] != 0) return (1);
+	b[0] = v3new(0, 1, 0);
+	b[1] = v3new(0, (real)3.5, 0);
+	hist3clear(c, 8);
+	hist3cross(&h, NULL, a, 0, 1, b, 2, c);
+	hist3cross(&h, &p, a, 0, 1, b, 2, c);
+	if (c[2] != 2 || c[1] != 1 || c[7] != 1) return (1);
+	hist3rdf(&h, c, 2, 2, 64, rdf);
+	if (!realeq(rdf[2], (real)(2 * 64 / (2 * 2 * 4.0 / 3.0 * M_PI *
+	    (1.5 * 1.5 * 1.5 - 1))), 10 * EPS) || rdf[0] != 0) return (1);
+	for (i = 0; i < 100; i++)
+		a[i] = v3new((real)(i * 37 % 101) * (real)0.1,
+		    (real)(i * 53 % 103) * (real)0.1,
+		    (real)(i * 71 % 107) * (real)0.1);
+	hist3clear(c, 8);
+	hist3clear(t, 8);
+	hist3self(&h, &s, a, 100, 0, 100, c);
+	for (i = 0; i < 100; i++)
+		for (j = i + 1; j < 100; j++)
+			hist3add(&h, pbc3distsq(&s, a[i], a[j]), t);
+	for (i = 0; i < 8; i++)
+		if (c[i] != t[i]) return (1);
+	hist3clear(c, 8);
+	hist3clear(t, 8);
+	hist3cross(&h, &s, a, 0, 50, a + 50, 50, c);
+	for (i = 0; i < 50; i++)
+		for (j = 50; j < 100; j++)
+			hist3add(&h, pbc3distsq(&s, a[i], a[j]), t);
+	for (i = 0; i < 8; i++)
+		if (c[i] != t[i]) return (1);
+
+	return (0);
+}
+
+static int
+test36(void)
+{
+	real ax[100], ay[100], az[100], bx[100], by[100], bz[100];
+	real cx[100], cy[100], cz[100], px[100], py[100], pz[100];
+	real e1x[100], e1y[100], e1z[100], e2x[100], e2y[100], e2z[100];
+	real tx[100], ty[100], tz[100], d2[100], s[100], t[100];
+	seg3 a = seg3new(v3new(0, 0, 0), v3new(2, 0, 0));
+	seg3 b = seg3new(v3new(1, -1, 1), v3new(1, 1, 1));
+	tri3 tr = tri3new(v3new(0, 0, 0), v3new(1, 0, 0), v3new(0, 1, 0));
+	plane3 pl = plane3tri(tr);
+	seg3soa sa, sb;
+	tri3soa ts;
+	v3soa p, c;
+	real u, v;
+	v3 q;
+	size_t i;
+
+	if (realclamp(2, 0, 1) != 1 || realclamp(-1, 0, 1) != 0) return (1);
+	if (!v3eq(seg3at(a, (real)0.25), v3new((real)0.5, 0, 0), EPS) ||
+	    !v3eq(seg3closest(a, v3new(3, 1, 0)), v3new(2, 0, 0), EPS) ||
+	    !v3eq(seg3closest(seg3new(a.a, a.a), v3new(3, 1, 0)), a.a, EPS))
+		return (1);
+	if (!realeq(seg3seg3(a, b, &u, &v), 1, EPS) ||
+	    !realeq(u, (real)0.5, EPS) || !realeq(v, (real)0.5, EPS))
+		return (1);
+	/* parallel and point segments */
+	if (!realeq(seg3seg3(a, seg3new(v3new(3, 1, 0), v3new(5, 1, 0)),
+	    NULL, NULL), 2, EPS) ||
+	    !realeq(seg3seg3(seg3new(b.a, b.a), a, NULL, &v), 2, EPS) ||
+	    !realeq(v, (real)0.5, EPS)) return (1);
+	if (!v3eq(tri3closest(tr, v3new((real)0.25, (real)0.25, 2)),
+	    v3new((real)0.25, (real)0.25, 0), EPS) ||
+	    !v3eq(tri3closest(tr, v3new(1, 1, 0)),
+	    v3new((real)0.5, (real)0.5, 0), EPS) ||
+	    !v3eq(tri3closest(tr, v3new(-1, -2, 3)), v3zero(), EPS))
+		return (1);
+	if (!v3eq(tri3closest(tri3new(a.a, a.b, v3new(1, 0, 0)),
+	    v3new(1, 1, 0)), v3new(1, 0, 0), EPS)) return (1);
+	if (!v3eq(pl.n, v3new(0, 0, 1), EPS) ||
+	    !realeq(plane3dist(pl, v3new(5, 5, -2)), -2, EPS) ||
+	    !v3eq(plane3closest(plane3new(v3new(0, 2, 0), v3new(0, 1, 0)),
+	    v3new(3, 5, 3)), v3new(3, 1, 3), EPS)) return (1);
+	sa.a.x = ax;
+	sa.a.y = ay;
+	sa.a.z = az;
+	sa.b.x = bx;
+	sa.b.y = by;
+	sa.b.z = bz;
+	sb.a.x = px;
+	sb.a.y = py;
+	sb.a.z = pz;
+	sb.b.x = cx;
+	sb.b.y = cy;
+	sb.b.z = cz;
+	v3soaset(sa.a, 0, a.a);
+	v3soaset(sa.b, 0, a.b);
+	v3soaset(sa.a, 1, b.a);
+	v3soaset(sa.b, 1, b.b);
+	v3soaset(sb.a, 0, b.a);
+	v3soaset(sb.b, 0, b.b);
+	v3soaset(sb.a, 1, b.a);
+	v3soaset(sb.b, 1, b.b);
+	seg3seg3soa(sa, sb, s, t, d2, 2);
+	if (!realeq(d2[0], 1, EPS) || d2[1] != 0 || !realeq(s[0], (real)0.5,
+	    EPS)) return (1);
+	p = sb.a;
+	c = sb.b;
+	v3soaset(p, 0, v3new(3, 1, 0));
+	v3soaset(p, 1, v3new(1, 0, 1));
+	seg3closestsoa(sa, p, c, d2, 2);
+	if (!v3eq(v3soaget(c, 0), v3new(2, 0, 0), EPS) ||
+	    !realeq(d2[0], 2, EPS) || d2[1] != 0) return (1);
+	ts.ax = tx;
+	ts.ay = ty;
+	ts.az = tz;
+	ts.e1x = e1x;
+	ts.e1y = e1y;
+	ts.e1z = e1z;
+	ts.e2x = e2x;
+	ts.e2y = e2y;
+	ts.e2z = e2z;
+	tri3soaset(ts, 0, tr.a, tr.b, tr.c);
+	tri3soaset(ts, 1, tr.a, tr.b, tr.c);
+	v3soaset(p, 0, v3new((real)0.25, (real)0.25, 2));
+	v3soaset(p, 1, v3new(1, 1, 0));
+	tri3closestsoa(ts, p, c, d2, 2);
+	if (!realeq(d2[0], 4, EPS) || !realeq(d2[1], (real)0.5, EPS) ||
+	    !v3eq(v3soaget(c, 1), v3new((real)0.5, (real)0.5, 0), EPS))
+		return (1);
+	plane3distsoa(pl, p, d2, 2);
+	if (!realeq(d2[0], 2, EPS) || d2[1] != 0 ||
+	    !v3eq(seg3soaget(sa, 1).b, b.b, EPS)) return (1);
+	/* more than one block, with point segments and flat triangles */
+	for (i = 0; i < 100; i++) {
+		q = v3new((real)(i % 5) - 2, (real)(i * 3 % 7) - 3,
+		    (real)(i * 5 % 11) - 5);
+		v3soaset(sa.a, i, q);
+		v3soaset(sa.b, i, i % 7 ? v3new(q.z, q.x, 1) : q);
+		v3soaset(sb.a, i, v3new(q.y, 2, q.x));
+		v3soaset(sb.b, i, i % 11 ? v3new(-q.x, q.z, q.y) :
+		    v3new(q.y, 2, q.x));
+		tri3soaset(ts, i, q, v3new(q.z, q.x, 1), i % 13 ?
+		    v3new(q.y, 2, q.x) : v3mul(v3add(q, v3new(q.z, q.x, 1)),
+		    (real)0.5));
+	}
+	seg3seg3soa(sa, sb, s, t, d2, 100);
+	for (i = 0; i < 100; i++)
+		if (!realeq(seg3seg3(seg3soaget(sa, i), seg3soaget(sb, i), &u,
+		    &v), d2[i], 100 * EPS) || !realeq(u, s[i], 100 * EPS) ||
+		    !realeq(v, t[i], 100 * EPS)) return (1);
+	p = sb.a;
+	c = sb.b;
+	seg3closestsoa(sa, p, c, d2, 100);
+	for (i = 0; i < 100; i++) {
+		q = seg3closest(seg3soaget(sa, i), v3soaget(p, i));
+		if (!v3eq(v3soaget(c, i), q, 100 * EPS) ||
+		    !realeq(d2[i], v3distsq(q, v3soaget(p, i)), 100 * EPS))
+			return (1);
+	}
+	tri3closestsoa(ts, p, c, d2, 100);
+	for (i = 0; i < 100; i++) {
+		q = tri3closestedges(v3new(tx[i], ty[i], tz[i]),
+		    v3new(e1x[i], e1y[i], e1z[i]),
+		    v3new(e2x[i], e2y[i], e2z[i]), v3soaget(p, i));
+		if (!v3eq(v3soaget(c, i), q, 100 * EPS) ||
+		    !realeq(d2[i], v3distsq(q, v3soaget(p, i)), 100 * EPS))
+			return (1);
+	}
+
+	return (0);
+}
+
 int
 main(void)
 {
@@ -266,6 +1811,33 @@ main(void)
 	if (test09()) return (1);
 	if (test10()) return (1);
 	if (test11()) return (1);
+	if (test12()) return (1);
+	if (test13()) return (1);
+	if (test14()) return (1);
+	if (test15()) return (1);
+	if (test16()) return (1);
+	if (test17()) return (1);
+	if (test18()) return (1);
+	if (test19()) return (1);
+	if (test20()) return (1);
+	if (test21()) return (1);
+	if (test22()) return (1);
+	if (test23()) return (1);
+	if (test24()) return (1);
+	if (test25()) return (1);
+	if (test26()) return (1);
+#ifdef LINALG_PROFILE
+	if (test27()) return (1);
+#endif
+	if (test28()) return (1);
+	if (test29()) return (1);
+	if (test30()) return (1);
+	if (test31()) return (1);
+	if (test32()) return (1);
+	if (test33()) return (1);
+	if (test34()) return (1);
+	if (test35()) return (1);
+	if (test36()) return (1);
 
 	return (0);
 }